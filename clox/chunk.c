@@ -8,7 +8,12 @@ void initChunk( Chunk* chunk ) {
     chunk->capacity = 0;
     chunk->count = 0;
     chunk->code = NULL;
+    chunk->lineCapacity = 0;
+    chunk->lineCount = 0;
     chunk->lines = NULL;
+    chunk->inlineCapacity = 0;
+    chunk->inlineCount = 0;
+    chunk->inlines = NULL;
     initValueArray( &chunk->constants );
 }
 
@@ -18,12 +23,22 @@ void writeChunk( Chunk* chunk, uint8_t byte, int line ) {
         size_t oldCapacity = chunk->capacity;
         chunk->capacity = growCapacity( chunk->capacity );
         chunk->code = growArray( sizeof( uint8_t ), chunk->code, oldCapacity, chunk->capacity );
-        chunk->lines = growArray( sizeof( int ), chunk->lines, oldCapacity, chunk->capacity );
     }
 
-    // insert byte & line
+    // insert byte
     chunk->code[chunk->count] = byte;
-    chunk->lines[chunk->count] = line;
+
+    // drop runs that start past the end (the compiler sometimes un-writes bytes by lowering count), then start a new
+    //  run if the line changed
+    while( chunk->lineCount > 0 && chunk->lines[chunk->lineCount - 1].start >= chunk->count ) chunk->lineCount--;
+    if( 0 == chunk->lineCount || chunk->lines[chunk->lineCount - 1].line != line ) {
+        if( chunk->lineCapacity < chunk->lineCount + 1 ) {
+            size_t oldCapacity = chunk->lineCapacity;
+            chunk->lineCapacity = growCapacity( chunk->lineCapacity );
+            chunk->lines = growArray( sizeof( LineRun ), chunk->lines, oldCapacity, chunk->lineCapacity );
+        }
+        chunk->lines[chunk->lineCount++] = (LineRun){ (uint32_t)chunk->count, line };
+    }
 
     // increment count
     chunk->count++;
@@ -31,11 +46,39 @@ void writeChunk( Chunk* chunk, uint8_t byte, int line ) {
 
 void freeChunk( Chunk* chunk ) {
     freeArray( sizeof( uint8_t ), chunk->code, chunk->capacity );
-    freeArray( sizeof( int ), chunk->lines, chunk->capacity );
+    freeArray( sizeof( LineRun ), chunk->lines, chunk->lineCapacity );
+    freeArray( sizeof( InlineRange ), chunk->inlines, chunk->inlineCapacity );
     freeValueArray( &chunk->constants );
     initChunk( chunk );
 }
 
+int getLine( Chunk* chunk, size_t offset ) {
+    // binary search for the last run starting at or before offset
+    size_t lo = 0, hi = chunk->lineCount;
+    while( hi - lo > 1 ) {
+        size_t mid = lo + (hi - lo) / 2;
+        if( chunk->lines[mid].start <= offset ) lo = mid;
+        else hi = mid;
+    }
+    return 0 == chunk->lineCount ? 0 : chunk->lines[lo].line;
+}
+
+void addInline( Chunk* chunk, InlineRange range ) {
+    if( chunk->inlineCapacity < chunk->inlineCount + 1 ) {
+        size_t oldCapacity = chunk->inlineCapacity;
+        chunk->inlineCapacity = growCapacity( chunk->inlineCapacity );
+        chunk->inlines = growArray( sizeof( InlineRange ), chunk->inlines, oldCapacity, chunk->inlineCapacity );
+    }
+    chunk->inlines[chunk->inlineCount++] = range;
+}
+
+InlineRange* findInline( Chunk* chunk, size_t offset ) {
+    for( size_t i = 0; i < chunk->inlineCount && chunk->inlines[i].start <= offset; i++ ) {
+        if( offset < chunk->inlines[i].end ) return &chunk->inlines[i];
+    }
+    return NULL;
+}
+
 size_t addConstant( Chunk* chunk, Value value ) {
     push( value ); // ensure GC can see this value BEFORE we call writeValueArray (which may trigger a GC)
     writeValueArray( &chunk->constants, value );
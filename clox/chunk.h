@@ -5,10 +5,13 @@
 // types
 typedef enum {
     OP_CONSTANT,
+    OP_SMALLINT, // pushes a small int immediate (operand: signed byte), instead of loading a constant
+    OP_SMALLINT_16, // same, w/ a signed 16-bit operand
     OP_NIL,
     OP_TRUE,
     OP_FALSE,
     OP_POP,
+    OP_POPN, // pops several values (operand: count), from runs of OP_POP (see optimizer.h)
     OP_DEFINE_GLOBAL,
     OP_GET_GLOBAL,
     OP_SET_GLOBAL,
@@ -16,6 +19,7 @@ typedef enum {
     OP_SET_LOCAL,
     OP_GET_UPVALUE,
     OP_SET_UPVALUE,
+    OP_GET_CAPTURE, // reads a variable captured by value (see ObjClosure)
     OP_GET_PROPERTY,
     OP_SET_PROPERTY,
     OP_EQUAL,
@@ -32,7 +36,7 @@ typedef enum {
     OP_JUMP_IF_FALSE, // forward branch
     OP_LOOP, // backward branch
     OP_CALL, // function call
-    OP_INVOKE, // optimization: fast version of a method call
+    OP_INVOKE, // optimization: fast version of a method call (operands: name, arg count, cached vtable slot)
     OP_CLOSURE, // closure creation
     OP_CLOSE_UPVALUE, // upvalue creation
     OP_RETURN,
@@ -40,13 +44,54 @@ typedef enum {
     OP_METHOD, // method creation
     OP_INHERIT,
     OP_GET_SUPER,
-    OP_SUPER_INVOKE, // optimization: fast version of method call on super
+    OP_SUPER_INVOKE, // optimization: fast version of method call on super (same operands as OP_INVOKE)
+    OP_ARRAY, // array literal
+    OP_GET_INDEX, // array[index] or map[key]
+    OP_SET_INDEX,
+    OP_GUARD_CALL, // inlined call (operands: jump, function, arg count): runs the body that follows if the callee is still
+                   //  that function, else makes a real call & jumps past it (see emitInline in compiler.c)
+    OP_GUARD_INVOKE, // same, for a method called on 'this' (+ a cached vtable slot, like OP_INVOKE)
+    OP_PEEK, // pushes a copy of a value below the top of the stack (operand: distance), for inlined parameters
+    OP_INLINE_RETURN, // replaces the inlined callee & its arguments w/ the result on top (operand: # of values)
+    OP_HOIST_GLOBAL, // finds a global (operand: name) before a loop, into 2 hidden locals: its entry & the epoch it was found in
+    OP_HOIST_FIELD, // same, for a field of 'this'
+    OP_GET_HOISTED_GLOBAL, // reads a hoisted global (operands: 1st hidden local, name), finding it again if it's stale
+    OP_GET_HOISTED_FIELD, // same, for a hoisted field
+    OP_ADD_NUM, // arithmetic & comparisons the optimizer proved only ever see numbers (so the VM skips the type checks)
+    OP_SUBTRACT_NUM,
+    OP_MULTIPLY_NUM,
+    OP_DIVIDE_NUM,
+    OP_GREATER_NUM,
+    OP_LESS_NUM,
+    OP_NEGATE_NUM,
+    OP_FOR_PREP, // counted loop entry (operands: jump, counter slot, limit slot): skips the loop unless counter < limit
+    OP_FOR_LOOP, // counted loop end (same operands): adds 1 to the counter & jumps back while it's still < limit
+    OP_FOR_PREP_CONSTANT, // same, for a literal limit (operands: jump, counter slot, limit constant)
+    OP_FOR_LOOP_CONSTANT,
+    OP_WIDE, // prefix: doubles the width of the next instruction's 1st operand (constant/slot/index: 2 bytes, jump: 4 bytes)
 } OpCode;
 
+// line numbers are run-length encoded: each run is the offset of the 1st byte on a new line (see getLine)
+// (offsets fit in 32 bits, like the widest jump, so a run is only 8 bytes)
+typedef struct {
+    uint32_t start;
+    int line;
+} LineRun;
+
+// code inlined from another function, so stack traces can still show the call (see runtimeError)
+typedef struct {
+    size_t start, end; // offsets of the inlined code
+    int line; // line of the call
+    int function; // constant holding the function that was inlined
+} InlineRange;
+
 typedef struct {
     size_t capacity, count;
     uint8_t* code;
-    int* lines;
+    size_t lineCapacity, lineCount;
+    LineRun* lines;
+    size_t inlineCapacity, inlineCount;
+    InlineRange* inlines; // in order of offset
     ValueArray constants;
 } Chunk;
 
@@ -54,5 +99,8 @@ typedef struct {
 void initChunk( Chunk* chunk );
 void freeChunk( Chunk* chunk );
 void writeChunk( Chunk* chunk, uint8_t byte, int line );
+int getLine( Chunk* chunk, size_t offset ); // line of the byte at 'offset'
+void addInline( Chunk* chunk, InlineRange range );
+InlineRange* findInline( Chunk* chunk, size_t offset ); // the inlined code 'offset' is in (or NULL)
 size_t addConstant( Chunk* chunk, Value value ); // returns the constant's offset
 void printConstants( Chunk* chunk );
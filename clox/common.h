@@ -4,9 +4,15 @@
 #include <stddef.h>
 #include <stdint.h>
 #define UINT8_COUNT (UINT8_MAX + 1)
+#define UINT16_COUNT (UINT16_MAX + 1)
 
 // optimization
 #define NAN_BOXING
+#define OPTIMIZE_BYTECODE // comment out to run (& print) the compiler's bytecode as-is (see optimizer.h)
+#define INLINE_CALLS // comment out to compile every call as a real call (see emitInline in compiler.c)
+#define HOIST_LOADS // comment out to load globals & fields inside loops every time (see hoistLoads in compiler.c)
+#define NUMBER_TYPES // comment out to type check all arithmetic at runtime (see inferNumbers in optimizer.c, needs OPTIMIZE_BYTECODE)
+#define COUNTED_LOOPS // comment out to run every for loop generically (see countLoops in optimizer.c, needs OPTIMIZE_BYTECODE)
 
 // compilation
 //#define DEBUG_PRINT_SCAN
@@ -7,6 +7,7 @@
 #include "memory.h"
 #include "scanner.h"
 #include "object.h"
+#include "optimizer.h"
 #ifdef DEBUG_PRINT_CODE
 #include "debug.h"
 #endif
@@ -45,15 +46,45 @@ typedef struct {
 typedef struct {
     Token name;
     int depth;
-    bool isCaptured;
+    bool isCaptured; // captured by reference (through an upvalue), so it must be closed when it goes out of scope
+    bool isDefining; // a function declaration whose closure is still being created (so its value can't be copied yet)
 } Local;
 
-// closed-over variables
+// closed-over variables (also used for variables captured by value)
 typedef struct {
-    uint8_t index;
+    uint16_t index;
     bool isLocal;
 } Upvalue;
 
+// names that are assigned to anywhere in the source (see findAssignedNames)
+typedef struct {
+    const char* start;
+    int length;
+} Name;
+
+typedef struct {
+    size_t count, capacity;
+    Name* names;
+} NameSet;
+
+// a function whose body can be copied into the calls to it (see emitInline)
+typedef struct {
+    Token name;
+    ObjFunction* function;
+} InlineCandidate;
+
+typedef struct {
+    int count, capacity;
+    InlineCandidate* candidates;
+} CandidateList;
+
+// a load hoisted out of a loop into hidden locals (see hoistLoads)
+typedef struct {
+    Token name;
+    bool isField; // a field of 'this' (else a global)
+    int slot; // the 1st of its 2 hidden locals
+} Hoisted;
+
 // type of function the compiler is compiling
 typedef enum {
     TYPE_FUNCTION,
@@ -68,25 +99,130 @@ typedef struct Compiler {
     ObjFunction* function; // current function being compiled
     FunctionType type; // type of current function being compiled
     int localCount, scopeDepth;
-    Local locals[UINT8_COUNT];
-    Upvalue upvalues[UINT8_COUNT];
+    int lastGetProperty; // offset just past the last OP_GET_PROPERTY (see call)
+    int lastPropertyName; // ... & the constant it read
+    int lastJumpTarget; // offset the last forward jump was patched to land on
+    int lastGetGlobal; // offset just past the last OP_GET_GLOBAL (see call)
+    Token lastGlobal; // ... & the name it read
+    int lastThis; // offset just past the last 'this' (see dot)
+    // locals, upvalues & captures grow as needed (up to UINT16_COUNT each, see OP_WIDE), as scratch memory
+    Local* locals;
+    Upvalue* upvalues;
+    Upvalue* captures; // variables captured by value
+    int localCapacity, upvalueCapacity, captureCapacity;
+    int* constantSlots; // constants already in the chunk, so each value is only added once (see makeConstant)
+    int constantCapacity;
+    Hoisted* hoisted; // loads hoisted out of the loops we're in (scratch memory, see hoistLoads)
+    int hoistedCount, hoistedCapacity;
 } Compiler;
 
 typedef struct ClassCompiler {
     struct ClassCompiler* enclosing;
     bool hasSuperclass;
+    CandidateList methods; // methods compiled so far that can be inlined into 'this.method()' calls
 } ClassCompiler;
 
 // globals 
 Parser parser;
 Compiler* current = NULL;
 ClassCompiler* currentClass = NULL;
+NameSet assignedNames;
+CandidateList inlineFunctions; // global functions that can be inlined (& are never assigned to)
+bool longJumps; // emit every forward jump w/ a 32-bit offset (see compile)
+bool needLongJumps; // a 16-bit forward jump overflowed, so the source must be compiled again w/ longJumps
+
+// -- ESCAPE ANALYSIS --
+// a captured variable that is never reassigned can't be told apart from a copy of its value, so closures capture such
+//  variables by value (no ObjUpvalue to allocate, & nothing to close when the variable goes out of scope)
+// to find them, we prescan the source for every name that appears as an assignment target ('name =', but not
+//  'var name =' or '.name ='). this is by name rather than by variable, so shadowing only makes it more conservative
+
+static uint32_t hashName( const char* start, int length ) {
+    uint32_t hash = HASH_SEED;
+    for( int i = 0; i < length; i++ ) {
+        hash ^= (uint8_t)start[i];
+        hash *= HASH_PRIME;
+    }
+    return hash;
+}
+
+// finds a name's slot in a (power of 2 sized) open addressing set
+static Name* findName( Name* names, size_t capacity, const char* start, int length ) {
+    for( size_t i = hashName( start, length ) & (capacity - 1);; i = (i + 1) & (capacity - 1) ) {
+        Name* name = &names[i];
+        if( NULL == name->start ) return name;
+        if( name->length == length && 0 == memcmp( name->start, start, length ) ) return name;
+    }
+}
+
+static void addAssignedName( Token* token ) {
+    // grow the set (scratch memory, not owned by the GC)
+    if( (assignedNames.count + 1) * 2 > assignedNames.capacity ) {
+        size_t capacity = assignedNames.capacity < 16 ? 16 : assignedNames.capacity * 2;
+        Name* names = (Name*)calloc( capacity, sizeof( Name ) );
+        if( NULL == names ) exit( 1 );
+        for( size_t i = 0; i < assignedNames.capacity; i++ ) {
+            Name* name = &assignedNames.names[i];
+            if( NULL != name->start ) *findName( names, capacity, name->start, name->length ) = *name;
+        }
+        free( assignedNames.names );
+        assignedNames.names = names;
+        assignedNames.capacity = capacity;
+    }
+
+    // add the name
+    Name* name = findName( assignedNames.names, assignedNames.capacity, token->start, token->length );
+    if( NULL != name->start ) return;
+    name->start = token->start;
+    name->length = token->length;
+    assignedNames.count++;
+}
+
+static bool isAssignedName( Token* token ) {
+    if( 0 == assignedNames.count ) return false;
+    return NULL != findName( assignedNames.names, assignedNames.capacity, token->start, token->length )->start;
+}
+
+static void findAssignedNames( const char* source ) {
+    initScanner( source );
+    Token before = { TOKEN_EOF, NULL, 0, 0 }, previous = before;
+    for( Token token = scanToken(); TOKEN_EOF != token.type; token = scanToken() ) {
+        if( TOKEN_EQUAL == token.type && TOKEN_IDENTIFIER == previous.type && TOKEN_VAR != before.type && TOKEN_DOT != before.type )
+            addAssignedName( &previous );
+        before = previous;
+        previous = token;
+    }
+}
+
+static void freeAssignedNames() {
+    free( assignedNames.names );
+    assignedNames.names = NULL;
+    assignedNames.count = assignedNames.capacity = 0;
+}
+
+// makes room for 'count' elements in a compiler-owned array (scratch memory, not owned by the GC)
+static void growScratch( void** array, int* capacity, size_t size, int count ) {
+    if( count <= *capacity ) return;
+    int newCapacity = *capacity < 8 ? 8 : *capacity * 2;
+    void* grown = realloc( *array, size * newCapacity );
+    if( NULL == grown ) exit( 1 );
+    *array = grown;
+    *capacity = newCapacity;
+}
 
 // initializes the compiler state
 static void initCompiler( Compiler* compiler, FunctionType type ) {
     // setup variable tracking
     compiler->localCount = 0;
+    compiler->lastGetProperty = compiler->lastJumpTarget = compiler->lastGetGlobal = compiler->lastThis = -1;
     compiler->scopeDepth = 0;
+    compiler->constantSlots = NULL;
+    compiler->constantCapacity = 0;
+    compiler->hoisted = NULL;
+    compiler->hoistedCount = compiler->hoistedCapacity = 0;
+    compiler->locals = NULL;
+    compiler->upvalues = compiler->captures = NULL;
+    compiler->localCapacity = compiler->upvalueCapacity = compiler->captureCapacity = 0;
     
     // setup current function
     compiler->type = type;
@@ -102,9 +238,12 @@ static void initCompiler( Compiler* compiler, FunctionType type ) {
     else current->function->name = makeString( "main", 4 );
 
     // reserve the 1st stack slot for the main function object (without a name so we cannot refer to it within the code)
+    growScratch( (void**)&current->locals, &current->localCapacity, sizeof( Local ), 1 );
     Local* local = &current->locals[current->localCount++];
+    current->function->maxSlots = 1;
     local->depth = 0;
     local->isCaptured = false;
+    local->isDefining = false;
 
     // non-fuctions have access to 'this', which is placed into the 1st stack slot
     // question: why do we allow 'this' at the TYPE_SCRIPT scope?
@@ -182,6 +321,17 @@ static void consume( TokenType type, const char* message ) {
 static void emitByte( uint8_t byte ) { writeChunk( currentChunk(), byte, parser.previous.line ); }
 static void emitBytes( uint8_t byte1, uint8_t byte2 ) { emitByte( byte1 ); emitByte( byte2 ); }
 
+// emits an instruction w/ a constant, local or upvalue operand. operands that don't fit in a byte get an OP_WIDE
+//  prefix & 2 bytes instead, so only large functions pay for them
+static void emitOperand( uint8_t instruction, int operand ) {
+    if( operand > UINT8_MAX ) {
+        emitBytes( OP_WIDE, instruction );
+        emitBytes( (operand >> 8) & 0xff, operand & 0xff );
+    } else {
+        emitBytes( instruction, (uint8_t)operand );
+    }
+}
+
 // called for implicit returns only (or a return w/o a value), where we usually return NIL (except for initializers, where we return 'this')
 static void emitReturn() {
     if( current->type == TYPE_INITIALIZER ) {
@@ -192,33 +342,40 @@ static void emitReturn() {
     emitByte( OP_RETURN );
 }
 
+// forward jumps are emitted before we know how far they go, so they're 16-bit unless we're recompiling in longJumps
+//  mode (after one of them overflowed), where every forward jump is an OP_WIDE jump w/ a 32-bit offset
 static int emitJump( uint8_t jumpInstruction ) {
+    if( longJumps ) emitByte( OP_WIDE );
     emitByte( jumpInstruction );
     emitBytes( 0xff, 0xff ); // placeholder for jump
-    return currentChunk()->count - 2; // address of jump instruction
+    if( longJumps ) emitBytes( 0xff, 0xff );
+    return currentChunk()->count - (longJumps ? 4 : 2); // address of jump operand
 }
 
 static void patchJump( int jump ) {
-    // -2 to adjust for jump instruction itself
-    int jumpOffset = currentChunk()->count - jump - 2;
+    // adjust for the jump operand itself
+    int width = longJumps ? 4 : 2;
+    int jumpOffset = currentChunk()->count - jump - width;
 
-    // see if the offset we're jumping is too large for a 16-bit short jump
-    if( jumpOffset > UINT16_MAX ) error( "Too much code to jump over for a 16-bit jump." );
+    // see if the offset we're jumping is too large for a 16-bit short jump (if so, compile() starts over w/ long jumps)
+    if( !longJumps && jumpOffset > UINT16_MAX ) needLongJumps = true;
 
-    // encode the 'jumpOffset' into the bytecode as a 16-bit big-endian value
-    currentChunk()->code[jump] = (jumpOffset >> 8) & 0xff;
-    currentChunk()->code[jump + 1] = jumpOffset & 0xff;
+    // encode the 'jumpOffset' into the bytecode as a big-endian value
+    for( int i = 0; i < width; i++ ) currentChunk()->code[jump + i] = (jumpOffset >> (8 * (width - 1 - i))) & 0xff;
+    current->lastJumpTarget = (int)currentChunk()->count;
 }
 
 static void emitLoop( int loopStart ) {
-    // emit the loop instruction
-    emitByte( OP_LOOP );
-
-    // offset must include the LOOP instruction itself
-    int offset = currentChunk()->count - loopStart + 2;
-    if( offset > UINT16_MAX ) error( "Loop body too large for a 16-bit jump." );
-
-    // emit the offset parameter
+    // offset must include the LOOP instruction itself (we know how far back it goes, so only long loops are wide)
+    int offset = currentChunk()->count - loopStart + 3;
+    if( offset <= UINT16_MAX ) {
+        emitByte( OP_LOOP );
+        emitBytes( (offset >> 8) & 0xff, offset & 0xff );
+        return;
+    }
+    offset = currentChunk()->count - loopStart + 6;
+    emitBytes( OP_WIDE, OP_LOOP );
+    emitBytes( (offset >> 24) & 0xff, (offset >> 16) & 0xff );
     emitBytes( (offset >> 8) & 0xff, offset & 0xff );
 }
 
@@ -227,8 +384,11 @@ static ObjFunction* endCompiler() {
     // return from our 'main' function
     emitReturn();
 
-    // get the compiled function
+    // get the compiled function (& clean up its code while it's still rooted by this compiler)
     ObjFunction* function = current->function;
+    #ifdef OPTIMIZE_BYTECODE
+    if( !parser.hadError ) optimizeChunk( currentChunk(), current->function->arity );
+    #endif
 
     // disassemble code before running it
     #ifdef DEBUG_PRINT_CODE
@@ -241,7 +401,10 @@ static ObjFunction* endCompiler() {
     }
     #endif
 
-    // restore enclosing function's compiler
+    // restore enclosing function's compiler (function() still needs its upvalues & captures, & frees them)
+    free( current->constantSlots );
+    free( current->locals );
+    free( current->hoisted );
     current = current->enclosing;
     return function;
 }
@@ -255,7 +418,7 @@ static void beginScope() {
 static void endScope() {
     current->scopeDepth--;
 
-    // pop locals TODO: add a POPN instruction so we don't need so many individual pops
+    // pop locals (the optimizer turns runs of these into a single OP_POPN)
     while( current->localCount > 0 &&
            current->locals[current->localCount - 1].depth > current->scopeDepth ) {
         if( current->locals[current->localCount - 1].isCaptured ) emitByte( OP_CLOSE_UPVALUE );
@@ -265,13 +428,162 @@ static void endScope() {
 }
 
 // adds a constant into the static data section of the chunk, and returns its handle
-static uint8_t makeConstant( Value value ) {
-    int constant = addConstant( currentChunk(), value );
-    if( constant > UINT8_MAX ) { error( "Too many constants in one chunk." ); return 0; }
-    return (uint8_t)constant;
+// constants are deduped per chunk, so a name or literal used many times only takes up one slot
+// the side hash is an open addressing set of constant indices (+1, so 0 is empty), keyed by the constants' exact bits:
+//  valuesEqual won't do, since it treats values w/ different representations as equal (an SSO literal & a heap
+//  identifier w/ the same chars, an int & a double, -0 & 0), & the code reading a constant may depend on which it got
+static uint64_t constantBits( Value value ) {
+    #ifdef NAN_BOXING
+    return value;
+    #else
+    uint64_t bits = (uint64_t)value.type << 32;
+    switch( value.type ) {
+        case VAL_NIL:       return bits;
+        case VAL_BOOL:      return bits | AS_BOOL( value );
+        case VAL_NUMBER:    { memcpy( &bits, &AS_NUMBER( value ), sizeof( bits ) ); return bits; }
+        case VAL_OBJ:       return (uint64_t)(uintptr_t)AS_OBJ( value );
+        case VAL_ERROR:     return bits | AS_ERROR( value );
+    }
+    return bits; // unreachable
+    #endif
 }
 
-static void emitConstant( Value value ) { emitBytes( OP_CONSTANT, makeConstant( value ) ); }
+static bool constantsIdentical( Value a, Value b ) {
+    #ifdef NAN_BOXING
+    return a == b;
+    #else
+    return a.type == b.type && constantBits( a ) == constantBits( b );
+    #endif
+}
+
+static int* findConstantSlot( int* slots, int capacity, Value* constants, Value value ) {
+    uint64_t bits = constantBits( value );
+    for( uint32_t i = (uint32_t)((bits ^ (bits >> 29)) * 0x9E3779B97F4A7C15ull >> 32) & (capacity - 1);; i = (i + 1) & (capacity - 1) ) {
+        if( 0 == slots[i] || constantsIdentical( constants[slots[i] - 1], value ) ) return &slots[i];
+    }
+}
+
+static int makeConstant( Value value ) {
+    Chunk* chunk = currentChunk();
+
+    // grow the side hash (scratch memory, not owned by the GC)
+    if( ((int)chunk->constants.count + 1) * 2 > current->constantCapacity ) {
+        int capacity = current->constantCapacity < 16 ? 16 : current->constantCapacity * 2;
+        int* slots = (int*)calloc( capacity, sizeof( int ) );
+        if( NULL == slots ) exit( 1 );
+        for( size_t i = 0; i < chunk->constants.count; i++ ) {
+            *findConstantSlot( slots, capacity, chunk->constants.values, chunk->constants.values[i] ) = (int)i + 1;
+        }
+        free( current->constantSlots );
+        current->constantSlots = slots;
+        current->constantCapacity = capacity;
+    }
+
+    // reuse the constant if it's already in the chunk
+    int* slot = findConstantSlot( current->constantSlots, current->constantCapacity, chunk->constants.values, value );
+    if( 0 != *slot ) return *slot - 1;
+
+    int constant = addConstant( chunk, value );
+    if( constant > UINT16_MAX ) { error( "Too many constants in one chunk." ); return 0; }
+    *slot = constant + 1;
+    return constant;
+}
+
+static void emitConstant( Value value ) { emitOperand( OP_CONSTANT, makeConstant( value ) ); }
+
+// -- INLINING --
+// a call to a small leaf function (or a 'this.method()' call) whose callee we know at compile time gets a copy of the
+//  callee's body instead, so it doesn't pay for a frame. we know the callee when it's a global function that's never
+//  assigned to, or a method defined earlier in the same class. since globals can still be redefined (& subclasses can
+//  override methods), the body sits behind a guard that checks the callee at runtime, & makes a real call if it changed
+// the body reads its parameters where the arguments already sit on the stack (OP_PEEK), & its result replaces the
+//  callee & arguments (OP_INLINE_RETURN). the chunk's inline ranges let stack traces still show the inlined function
+#define INLINE_MAX_LENGTH 32 // most bytes of code a function can have & still be inlined (not counting its OP_RETURN)
+
+// stack effect & length of the instructions an inlinable body can have (length 0 for anything else: calls, jumps,
+//  stores, closures & wide operands all keep their function out of line)
+static int inlinedInstruction( uint8_t op, int* length ) {
+    switch( op ) {
+        case OP_NIL: case OP_TRUE: case OP_FALSE:                                   *length = 1; return 1;
+        case OP_CONSTANT: case OP_SMALLINT: case OP_GET_LOCAL: case OP_GET_GLOBAL:  *length = 2; return 1;
+        case OP_SMALLINT_16:                                                        *length = 3; return 1;
+        case OP_GET_PROPERTY:                                                       *length = 2; return 0;
+        case OP_NOT: case OP_NEGATE: case OP_NEGATE_NUM:                            *length = 1; return 0;
+        case OP_POP: case OP_EQUAL: case OP_GREATER: case OP_LESS: case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY:
+        case OP_DIVIDE: case OP_GET_INDEX: case OP_ADD_NUM: case OP_SUBTRACT_NUM: case OP_MULTIPLY_NUM:
+        case OP_DIVIDE_NUM: case OP_GREATER_NUM: case OP_LESS_NUM:                  *length = 1; return -1;
+        default:                                                                    *length = 0; return 0;
+    }
+}
+
+// a function is inlinable if its body is a short run of the instructions above, up to its 1st OP_RETURN (w/o any jumps,
+//  everything after that is dead), that only reads its own parameters
+static bool isInlinable( ObjFunction* function ) {
+    #ifndef INLINE_CALLS
+    return false;
+    #endif
+    if( 0 != function->upvalueCount || 0 != function->captureCount ) return false;
+    Chunk* chunk = &function->chunk;
+    int depth = 0, maxDepth = 0, length;
+    for( size_t offset = 0; offset < chunk->count && offset < INLINE_MAX_LENGTH; offset += length ) {
+        uint8_t op = chunk->code[offset];
+        if( OP_RETURN == op ) return function->arity + maxDepth < UINT8_MAX; // (see OP_PEEK & OP_INLINE_RETURN's operands)
+        depth += inlinedInstruction( op, &length );
+        if( 0 == length || offset + length > chunk->count ) return false;
+        if( OP_GET_LOCAL == op && chunk->code[offset + 1] > function->arity ) return false;
+        if( depth > maxDepth ) maxDepth = depth;
+    }
+    return false;
+}
+
+static void addCandidate( CandidateList* list, Token name, ObjFunction* function ) {
+    for( int i = 0; i < list->count; i++ ) {
+        if( lexemesEqual( &list->candidates[i].name, &name ) ) { list->candidates[i].function = function; return; }
+    }
+    growScratch( (void**)&list->candidates, &list->capacity, sizeof( InlineCandidate ), list->count + 1 );
+    list->candidates[list->count++] = (InlineCandidate){ name, function };
+}
+
+static ObjFunction* findCandidate( CandidateList* list, Token* name ) {
+    for( int i = 0; i < list->count; i++ ) if( lexemesEqual( &list->candidates[i].name, name ) ) return list->candidates[i].function;
+    return NULL;
+}
+
+// emits the guard & a copy of the callee's body (w/ the callee's lines, so errors in it point at the callee's code)
+static void emitInline( uint8_t guard, ObjFunction* function, uint8_t argCount ) {
+    Chunk* chunk = currentChunk();
+    Chunk* callee = &function->chunk;
+    int line = parser.previous.line, constant = makeConstant( OBJ_VAL( function ) );
+    int jump = emitJump( guard );
+    emitBytes( (constant >> 8) & 0xff, constant & 0xff );
+    emitByte( argCount );
+    if( OP_GUARD_INVOKE == guard ) emitByte( 0 ); // the VM caches the method's vtable slot here
+
+    InlineRange range = { chunk->count, 0, line, constant };
+    int depth = 0, length;
+    for( size_t offset = 0; OP_RETURN != callee->code[offset]; offset += length ) {
+        uint8_t op = callee->code[offset];
+        int calleeLine = getLine( callee, offset ), effect = inlinedInstruction( op, &length );
+        if( OP_GET_LOCAL == op ) {
+            writeChunk( chunk, OP_PEEK, calleeLine );
+            writeChunk( chunk, (uint8_t)(argCount + depth - callee->code[offset + 1]), calleeLine );
+        } else if( OP_CONSTANT == op || OP_GET_GLOBAL == op || OP_GET_PROPERTY == op ) {
+            // constants move into the caller's chunk (where they might need a wide operand)
+            int index = makeConstant( callee->constants.values[callee->code[offset + 1]] );
+            if( index > UINT8_MAX ) writeChunk( chunk, OP_WIDE, calleeLine );
+            writeChunk( chunk, op, calleeLine );
+            if( index > UINT8_MAX ) writeChunk( chunk, (uint8_t)(index >> 8), calleeLine );
+            writeChunk( chunk, (uint8_t)index, calleeLine );
+        } else {
+            for( int i = 0; i < length; i++ ) writeChunk( chunk, callee->code[offset + i], calleeLine );
+        }
+        depth += effect;
+    }
+    range.end = chunk->count;
+    addInline( chunk, range );
+    emitBytes( OP_INLINE_RETURN, argCount + 1 );
+    patchJump( jump );
+}
 
 // -- EXPRESSION PARSING --
 static void expression();
@@ -279,12 +591,21 @@ static ParseRule* getRule( TokenType type );
 static void parsePrecedence( Precedence precedence );
 static void statement();
 static void declaration();
-static uint8_t identifierConstant( Token* name );
+static int identifierConstant( Token* name );
 static void varDeclaration();
+static int findHoisted( Token* name, bool isField );
+static void addLocal( Token name );
 
 // parses number
 static void number( bool canAssign ) {
     double value = strtod( parser.previous.start, NULL );
+    if( value <= INT32_MAX && value == (double)(int32_t)value ) { // integral literals start out as small ints
+        int32_t i = (int32_t)value;
+        if( i <= INT8_MAX ) emitBytes( OP_SMALLINT, (uint8_t)i ); // literals are never negative (see unary)
+        else if( i <= INT16_MAX ) { emitBytes( OP_SMALLINT_16, (uint8_t)(i >> 8) ); emitByte( (uint8_t)i ); }
+        else emitConstant( INT_VAL( i ) );
+        return;
+    }
     emitConstant( NUMBER_VAL( value ) );
 }
 
@@ -319,7 +640,7 @@ static void binary( bool canAssign ) {
     // (this makes the operator left-associative)
     parsePrecedence( (Precedence)(rule->precedence + 1) );
 
-    // emit token for operator
+    // emit token for operator (the optimizer makes it unchecked if both sides are always numbers, see inferNumbers)
     switch( operatorType ) {
         case TOKEN_BANG_EQUAL:      emitBytes( OP_EQUAL, OP_NOT ); break;
         case TOKEN_EQUAL_EQUAL:     emitByte( OP_EQUAL ); break;
@@ -349,23 +670,88 @@ static uint8_t argumentList() {
 }
 
 static void call( bool canAssign ) {
+    // peephole: calling a property we just read (e.g. '(obj.method)()') becomes OP_INVOKE, so no bound method is made
+    // (unless a jump lands between the two, e.g. '(a and obj.method)()', where the read might not be what gets called)
+    Chunk* chunk = currentChunk();
+    int end = (int)chunk->count;
+    if( current->lastGetProperty == end && current->lastJumpTarget != end ) {
+        int name = current->lastPropertyName;
+        chunk->count -= name > UINT8_MAX ? 4 : 2; // drop the OP_GET_PROPERTY (see emitOperand)
+        uint8_t argCount = argumentList();
+        emitOperand( OP_INVOKE, name );
+        emitBytes( argCount, 0 );
+        return;
+    }
+
+    // calling a global function we know about inlines it (see emitInline)
+    ObjFunction* inlined = current->lastGetGlobal == end && current->lastJumpTarget != end ?
+        findCandidate( &inlineFunctions, &current->lastGlobal ) : NULL;
     uint8_t argCount = argumentList();
-    emitBytes( OP_CALL, argCount );
+    if( NULL != inlined && argCount == inlined->arity ) emitInline( OP_GUARD_CALL, inlined, argCount );
+    else emitBytes( OP_CALL, argCount );
 }
 
 static void dot( bool canAssign ) {
+    int end = (int)currentChunk()->count;
+    bool isThis = current->lastThis == end && current->lastJumpTarget != end && NULL != currentClass;
     consume( TOKEN_IDENTIFIER, "Expect property name after '.'." );
-    uint8_t name = identifierConstant( &parser.previous );
+    Token property = parser.previous;
+    int name = identifierConstant( &property );
 
     if( canAssign && match( TOKEN_EQUAL ) ) {
         expression();
-        emitBytes( OP_SET_PROPERTY, name );
+        emitOperand( OP_SET_PROPERTY, name );
     } else if( match( TOKEN_LEFT_PAREN ) ) { // optimization: instead allocating the ObjBoundMethod using OP_GET_PROPERTY just to invoke it once, use the special OP_INVOKE instruction
+        // calling one of this class's methods on 'this' inlines it (see emitInline)
+        ObjFunction* inlined = isThis ? findCandidate( &currentClass->methods, &property ) : NULL;
         uint8_t argCount = argumentList();
-        emitBytes( OP_INVOKE, name );
-        emitByte( argCount );
+        if( NULL != inlined && argCount == inlined->arity ) {
+            emitInline( OP_GUARD_INVOKE, inlined, argCount );
+            return;
+        }
+        emitOperand( OP_INVOKE, name );
+        emitBytes( argCount, 0 ); // the VM caches the method's vtable slot in the last byte
+
     } else {
-        emitBytes( OP_GET_PROPERTY, name );
+        // reading a field of 'this' that's hoisted out of a loop we're in replaces the load of 'this' (see hoistLoads)
+        Chunk* chunk = currentChunk();
+        int slot = isThis ? findHoisted( &property, true ) : -1;
+        if( -1 != slot && name <= UINT8_MAX && OP_GET_LOCAL == chunk->code[end - 2] && 0 == chunk->code[end - 1] ) {
+            chunk->count -= 2;
+            emitBytes( OP_GET_HOISTED_FIELD, (uint8_t)slot );
+            emitByte( (uint8_t)name );
+            return;
+        }
+        emitOperand( OP_GET_PROPERTY, name );
+        current->lastGetProperty = (int)currentChunk()->count;
+        current->lastPropertyName = name;
+    }
+}
+
+// parses an array literal, e.g. [1, 2, 3] (prefix expression)
+static void arrayLiteral( bool canAssign ) {
+    uint8_t count = 0;
+    if( !check( TOKEN_RIGHT_BRACKET ) ) {
+        do {
+            expression();
+            if( 255 == count ) error( "Can't have more than 255 elements in an array literal." );
+            count++;
+        } while( match( TOKEN_COMMA ) );
+    }
+    consume( TOKEN_RIGHT_BRACKET, "Expect ']' after array elements." );
+    emitBytes( OP_ARRAY, count );
+}
+
+// parses an index expression, e.g. a[i] or a[i] = v (infix expression)
+static void subscript( bool canAssign ) {
+    expression();
+    consume( TOKEN_RIGHT_BRACKET, "Expect ']' after index." );
+
+    if( canAssign && match( TOKEN_EQUAL ) ) {
+        expression();
+        emitByte( OP_SET_INDEX );
+    } else {
+        emitByte( OP_GET_INDEX );
     }
 }
 
@@ -379,7 +765,7 @@ static void literal( bool canAssign ) {
 }
 
 static void string( bool canAssign ) {
-    emitConstant( OBJ_VAL( makeString( parser.previous.start + 1, parser.previous.length - 2 ) ) );
+    emitConstant( makeStringValue( parser.previous.start + 1, parser.previous.length - 2 ) );
 }
 
 // figure out the stack index for the local. note that this goes backwards to inner scoped variables shadow those of outer scopes.
@@ -397,33 +783,39 @@ static int resolveLocal( Compiler* compiler, Token* name ) {
     return -1; // we couldn't find it, so it must be a global variable
 }
 
-static int addUpvalue( Compiler* compiler, uint8_t index, bool isLocal ) {
+// adds an upvalue (or a by-value capture) to the function, unless it already has one for that variable
+static int addUpvalue( Compiler* compiler, int index, bool isLocal, bool byValue ) {
     // check to see if there's already an upvalue for this
-    int upvalueCount = compiler->function->upvalueCount;
-    for( int i = 0; i < upvalueCount; i++ ) {
-        Upvalue* upvalue = &compiler->upvalues[i];
+    Upvalue** upvalues = byValue ? &compiler->captures : &compiler->upvalues;
+    int* upvalueCount = byValue ? &compiler->function->captureCount : &compiler->function->upvalueCount;
+    for( int i = 0; i < *upvalueCount; i++ ) {
+        Upvalue* upvalue = &(*upvalues)[i];
         if( upvalue->index == index && upvalue->isLocal == isLocal ) return i;
     }
 
     // otherwise: add the upvalue 
-    if( UINT8_COUNT == upvalueCount ) { error( "Too many closure variables in function." ); return 0; }
-    compiler->upvalues[upvalueCount].isLocal = isLocal;
-    compiler->upvalues[upvalueCount].index = index;
-    return compiler->function->upvalueCount++;
+    if( UINT16_COUNT == *upvalueCount ) { error( "Too many closure variables in function." ); return 0; }
+    growScratch( (void**)upvalues, byValue ? &compiler->captureCapacity : &compiler->upvalueCapacity, sizeof( Upvalue ), *upvalueCount + 1 );
+    (*upvalues)[*upvalueCount].isLocal = isLocal;
+    (*upvalues)[*upvalueCount].index = (uint16_t)index;
+    return (*upvalueCount)++;
 }
 
-static int resolveUpvalue( Compiler* compiler, Token* name ) {
+static int resolveUpvalue( Compiler* compiler, Token* name, bool* byValue ) {
     // base case: see if enclosing function contains a local we can close over
     if( NULL == compiler->enclosing ) return -1;
     int local = resolveLocal( compiler->enclosing, name );
     if( -1 != local ) {
-        compiler->enclosing->locals[local].isCaptured = true;
-        return addUpvalue( compiler, (uint8_t)local, true );
+        // capture it by value if it's never reassigned (& already holds its final value)
+        Local* l = &compiler->enclosing->locals[local];
+        *byValue = !l->isDefining && !isAssignedName( name );
+        if( !*byValue ) l->isCaptured = true;
+        return addUpvalue( compiler, local, true, *byValue );
     }
 
-    // otherwise: no local found, so try to find upvalue in the enclosing compiler
-    int upvalue = resolveUpvalue( compiler->enclosing, name );
-    if( -1 != upvalue ) return addUpvalue( compiler, (uint8_t)upvalue, false );
+    // otherwise: no local found, so try to find upvalue in the enclosing compiler (& capture it the same way it does)
+    int upvalue = resolveUpvalue( compiler->enclosing, name, byValue );
+    if( -1 != upvalue ) return addUpvalue( compiler, upvalue, false, *byValue );
 
     // otherwise: we have a global
     return -1;
@@ -433,12 +825,13 @@ static void namedVariable( Token name, bool canAssign ) {
     // see if this is a local variable
     int arg = resolveLocal( current, &name );
     uint8_t getOp, setOp;
+    bool byValue = false;
     if( -1 != arg ) {
         getOp = OP_GET_LOCAL;
         setOp = OP_SET_LOCAL;
-    } else if( -1 != (arg = resolveUpvalue( current, &name )) ) {
-        getOp = OP_GET_UPVALUE;
-        setOp = OP_SET_UPVALUE;
+    } else if( -1 != (arg = resolveUpvalue( current, &name, &byValue )) ) {
+        getOp = byValue ? OP_GET_CAPTURE : OP_GET_UPVALUE;
+        setOp = OP_SET_UPVALUE; // note: names captured by value are never assigned to (see findAssignedNames)
     } else {
         getOp = OP_GET_GLOBAL;
         setOp = OP_SET_GLOBAL;
@@ -448,12 +841,22 @@ static void namedVariable( Token name, bool canAssign ) {
     // check if this is a variable assignment -- note: we could instead check for TOKEN_EQUAL, and report "Invalid assignment target." (for example, 2 * x = 3 would hit this), but we don't have to, b/c the expression would end at 'x', and therefore expect ';' instead of '=', so we get an error anyway
     if( canAssign && match( TOKEN_EQUAL ) ) {
         expression();
-        emitBytes( setOp, (uint8_t)arg );
+        emitOperand( setOp, arg );
         return;
     }
 
-    // otherwise, this is a regular get expression
-    emitBytes( getOp, (uint8_t)arg );
+    // otherwise, this is a regular get expression (or a read of a global hoisted out of a loop we're in)
+    int slot = OP_GET_GLOBAL == getOp ? findHoisted( &name, false ) : -1;
+    if( -1 != slot && arg <= UINT8_MAX ) {
+        emitBytes( OP_GET_HOISTED_GLOBAL, (uint8_t)slot );
+        emitByte( (uint8_t)arg );
+    } else {
+        emitOperand( getOp, arg );
+    }
+    if( OP_GET_GLOBAL == getOp ) {
+        current->lastGetGlobal = (int)currentChunk()->count;
+        current->lastGlobal = name;
+    }
 }
 
 static void variable( bool canAssign ) {
@@ -467,6 +870,7 @@ static void this_( bool canAssign ) {
     }
 
     variable( false );
+    current->lastThis = (int)currentChunk()->count;
 }
 
 static void and( bool canAssign ) {
@@ -509,7 +913,7 @@ static void super_( bool canAssign ) {
     // get the name of the method being called
     consume( TOKEN_DOT, "Expect '.' after 'super'." );
     consume( TOKEN_IDENTIFIER, "Expect superclass method name." );
-    uint8_t name = identifierConstant( &parser.previous );
+    int name = identifierConstant( &parser.previous );
 
     // push 'this' onto stack
     namedVariable( syntheticToken( "this" ), false );
@@ -519,12 +923,12 @@ static void super_( bool canAssign ) {
         // if so, we can use a fast path
         uint8_t argCount = argumentList();
         namedVariable( syntheticToken( "super" ), false );
-        emitBytes( OP_SUPER_INVOKE, name );
-        emitByte( argCount );
+        emitOperand( OP_SUPER_INVOKE, name );
+        emitBytes( argCount, 0 ); // the VM caches the method's vtable slot in the last byte
     } else {
         // push super onto stack, then call OP_GET_SUPER
         namedVariable( syntheticToken( "super" ), false );
-        emitBytes( OP_GET_SUPER, name );
+        emitOperand( OP_GET_SUPER, name );
     } 
 }
 
@@ -534,6 +938,8 @@ ParseRule rules[] = {
     [TOKEN_RIGHT_PAREN]   = {NULL,     NULL,   PRECEDENCE_NONE},
     [TOKEN_LEFT_BRACE]    = {NULL,     NULL,   PRECEDENCE_NONE}, 
     [TOKEN_RIGHT_BRACE]   = {NULL,     NULL,   PRECEDENCE_NONE},
+    [TOKEN_LEFT_BRACKET]  = {arrayLiteral, subscript, PRECEDENCE_CALL},
+    [TOKEN_RIGHT_BRACKET] = {NULL,     NULL,   PRECEDENCE_NONE},
     [TOKEN_COMMA]         = {NULL,     NULL,   PRECEDENCE_NONE},
     [TOKEN_DOT]           = {NULL,     dot,    PRECEDENCE_CALL},
     [TOKEN_MINUS]         = {unary,    binary, PRECEDENCE_TERM},
@@ -642,7 +1048,149 @@ static void printStatement() {
     emitByte( OP_PRINT );
 }
 
+// -- LOOP-INVARIANT LOADS --
+// where a global (or field of 'this') lives doesn't change inside a loop unless a key is added or deleted, so the
+//  lookups are done once, before the loop, & kept in hidden locals. inside the loop, reads go straight to the entry, &
+//  only look again if the vm's epoch says a key came or went since (see OP_GET_HOISTED_GLOBAL). stores still go through
+//  the table, so nothing needs invalidating when a value changes
+// the lookups have to be emitted before the body is compiled, so we find the names by scanning the loop's tokens ahead
+//  of time (a name that turns out to be a local inside the loop just never uses its hidden locals)
+#define MAX_HOISTED 8 // most loads hoisted out of one loop (each one takes 2 stack slots while the loop runs)
+
+// a name a loop reads
+typedef struct {
+    Token name;
+    bool isField;
+} LoopName;
+
+typedef struct {
+    Token tokens[4]; // the last 4 tokens scanned (tokens[3] is the next one to skip, tokens[2] is the one we classify)
+    LoopName* names;
+    int count, capacity;
+} LoopScan;
+
+static void addLoopName( LoopScan* scan, Token* name, bool isField ) {
+    for( int i = 0; i < scan->count; i++ ) {
+        if( scan->names[i].isField == isField && lexemesEqual( &scan->names[i].name, name ) ) return;
+    }
+    growScratch( (void**)&scan->names, &scan->capacity, sizeof( LoopName ), scan->count + 1 );
+    scan->names[scan->count++] = (LoopName){ *name, isField };
+}
+
+// scans a token, & classifies the one before it (now that we know what follows it)
+static void scanLoopToken( LoopScan* scan ) {
+    Token* t = scan->tokens;
+    t[0] = t[1];
+    t[1] = t[2];
+    t[2] = t[3];
+    t[3] = scanToken();
+    if( TOKEN_IDENTIFIER != t[2].type || TOKEN_EQUAL == t[3].type ) return; // (stores don't use the hidden locals)
+    if( TOKEN_DOT != t[1].type ) addLoopName( scan, &t[2], false );
+    else if( TOKEN_THIS == t[0].type && TOKEN_LEFT_PAREN != t[3].type ) addLoopName( scan, &t[2], true ); // not an invoke
+}
+
+// skips to just past the 'close' that ends the group we're in
+static void skipLoopGroup( LoopScan* scan, TokenType open, TokenType close ) {
+    for( int depth = 0; TOKEN_EOF != scan->tokens[3].type; ) {
+        TokenType type = scan->tokens[3].type;
+        scanLoopToken( scan );
+        if( open == type ) depth++;
+        else if( close == type && 0 == depth-- ) return;
+    }
+}
+
+static void skipLoopStatement( LoopScan* scan ) {
+    TokenType type = scan->tokens[3].type;
+    if( TOKEN_EOF == type ) return;
+    scanLoopToken( scan );
+    switch( type ) {
+        case TOKEN_LEFT_BRACE:
+            skipLoopGroup( scan, TOKEN_LEFT_BRACE, TOKEN_RIGHT_BRACE );
+            return;
+        case TOKEN_IF:
+            scanLoopToken( scan ); // '('
+            skipLoopGroup( scan, TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN );
+            skipLoopStatement( scan );
+            if( TOKEN_ELSE == scan->tokens[3].type ) {
+                scanLoopToken( scan );
+                skipLoopStatement( scan );
+            }
+            return;
+        case TOKEN_WHILE: case TOKEN_FOR:
+            scanLoopToken( scan ); // '('
+            skipLoopGroup( scan, TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN );
+            skipLoopStatement( scan );
+            return;
+        default: // anything else ends w/ a ';' (expressions can't hold statements)
+            while( TOKEN_SEMICOLON != type && TOKEN_EOF != scan->tokens[3].type ) {
+                type = scan->tokens[3].type;
+                scanLoopToken( scan );
+            }
+            return;
+    }
+}
+
+// true if a name is a local of this function, or of a function it's nested in
+static bool isLocalName( Token* name ) {
+    for( Compiler* compiler = current; NULL != compiler; compiler = compiler->enclosing ) {
+        for( int i = 0; i < compiler->localCount; i++ ) if( lexemesEqual( name, &compiler->locals[i].name ) ) return true;
+    }
+    return false;
+}
+
+static int findHoisted( Token* name, bool isField ) {
+    for( int i = current->hoistedCount - 1; i >= 0; i-- ) {
+        Hoisted* hoisted = &current->hoisted[i];
+        if( hoisted->isField == isField && lexemesEqual( &hoisted->name, name ) ) return hoisted->slot;
+    }
+    return -1;
+}
+
+// scans the loop we're at the start of (inside its '(' already, for a 'for' loop), & emits the hidden locals for the
+//  globals (& fields of 'this') it reads. returns the hoisted count to go back to once the loop (& the scope holding the hidden locals) ends
+static int hoistLoads( bool isInGroup ) {
+    int hoistedCount = current->hoistedCount;
+    #ifndef HOIST_LOADS
+    return hoistedCount;
+    #endif
+
+    // scan ahead to the end of the loop, then put the scanner back
+    LoopScan scan = { .names = NULL, .count = 0, .capacity = 0 };
+    scan.tokens[0] = scan.tokens[1] = (Token){ TOKEN_EOF, NULL, 0, 0 };
+    scan.tokens[2] = parser.previous;
+    scan.tokens[3] = parser.current;
+    Scanner saved = scanner;
+    if( !isInGroup ) scanLoopToken( &scan ); // '('
+    skipLoopGroup( &scan, TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN );
+    skipLoopStatement( &scan );
+    scanner = saved;
+
+    // hoist what isn't a local (or already hoisted)
+    bool hasThis = TYPE_METHOD == current->type || TYPE_INITIALIZER == current->type;
+    for( int i = 0, count = 0; i < scan.count && count < MAX_HOISTED; i++ ) {
+        LoopName* name = &scan.names[i];
+        if( name->isField ? !hasThis : isLocalName( &name->name ) ) continue;
+        if( -1 != findHoisted( &name->name, name->isField ) || current->localCount + 2 > UINT8_COUNT ) continue;
+        int constant = identifierConstant( &name->name );
+        if( constant > UINT8_MAX ) continue;
+        emitBytes( name->isField ? OP_HOIST_FIELD : OP_HOIST_GLOBAL, (uint8_t)constant );
+        growScratch( (void**)&current->hoisted, &current->hoistedCapacity, sizeof( Hoisted ), current->hoistedCount + 1 );
+        current->hoisted[current->hoistedCount++] = (Hoisted){ name->name, name->isField, current->localCount };
+        for( int j = 0; j < 2; j++ ) {
+            addLocal( syntheticToken( "" ) ); // (no name, so nothing can refer to it)
+            current->locals[current->localCount - 1].depth = current->scopeDepth;
+        }
+        count++;
+    }
+    free( scan.names );
+    return hoistedCount;
+}
+
 static void whileStatement() {
+    // load what the loop only reads into hidden locals, which live as long as the loop
+    beginScope();
+    int hoisted = hoistLoads( false );
+
     // save start
     int loopStart = currentChunk()->count;
 
@@ -662,6 +1210,8 @@ static void whileStatement() {
     // exit
     patchJump( exitJump );
     emitByte( OP_POP );
+    endScope();
+    current->hoistedCount = hoisted;
 }
 
 static void forStatement() {
@@ -671,6 +1221,7 @@ static void forStatement() {
     
     // initializer
     if( match( TOKEN_SEMICOLON ) ); else if( match( TOKEN_VAR ) ) varDeclaration(); else expressionStatement();
+    int hoisted = hoistLoads( true );
 
     // condition
     int loopStart = currentChunk()->count, exitJump = -1;
@@ -680,12 +1231,12 @@ static void forStatement() {
         exitJump = emitJump( OP_JUMP_IF_FALSE ); // leave the loop if the condition is false
         emitByte( OP_POP ); // pop condition
     }
-    
+
     // increment
     if( !match( TOKEN_RIGHT_PAREN ) ) {
         // increment doesn't run on first loop iteration, so jump over it
         int bodyJump = emitJump( OP_JUMP ), incrementStart = currentChunk()->count;
-        
+
         // increment body
         expression();
         emitByte( OP_POP );
@@ -713,6 +1264,7 @@ static void forStatement() {
     
     // end scope
     endScope();
+    current->hoistedCount = hoisted;
 }
 
 static void synchronize() {
@@ -774,16 +1326,19 @@ static void statement() {
 // creates a new local variable
 static void addLocal( Token name ) {
     // ensure we don't overflow our maximum # of locals
-    if( UINT8_COUNT == current->localCount ) {
+    if( UINT16_COUNT == current->localCount ) {
         error( "Too many local variables in function." );
         return;
     }
     
     // otherwise, create the local
+    growScratch( (void**)&current->locals, &current->localCapacity, sizeof( Local ), current->localCount + 1 );
     Local* local = &current->locals[current->localCount++];
+    if( current->localCount > current->function->maxSlots ) current->function->maxSlots = current->localCount;
     local->name = name;
     local->depth = -1; // special value which indicates that the variable is declared but undefined
     local->isCaptured = false;
+    local->isDefining = false;
 }
 
 static void declareVariable() {
@@ -815,7 +1370,7 @@ static void markInitialized() { // give the variable a depth value, which marks
     current->locals[current->localCount - 1].depth = current->scopeDepth;
 }
 
-static void defineVariable( uint8_t global ) {
+static void defineVariable( int global ) {
     // define local variable: no OPCODE required to define variable, b/c we just let the value sit in the stack AS the local variable
     if( current->scopeDepth > 0 ) {
         markInitialized();
@@ -823,14 +1378,14 @@ static void defineVariable( uint8_t global ) {
     }
 
     // define global varible
-    emitBytes( OP_DEFINE_GLOBAL, global );
+    emitOperand( OP_DEFINE_GLOBAL, global );
 }
 
-static uint8_t identifierConstant( Token* name ) {
+static int identifierConstant( Token* name ) {
     return makeConstant( OBJ_VAL( makeString( name->start, name->length ) ) );
 }
 
-static uint8_t parseVariable( const char* errorMessage ) {
+static int parseVariable( const char* errorMessage ) {
     // consume the identifier
     consume( TOKEN_IDENTIFIER, errorMessage );
     
@@ -848,7 +1403,7 @@ static uint8_t parseVariable( const char* errorMessage ) {
 //       right now, we'll create another identical constant, but the actual global in the VM will be overwritten
 static void varDeclaration() {
     // create constant w/ name of variable
-    uint8_t global = parseVariable( "Expect variable name." );
+    int global = parseVariable( "Expect variable name." );
 
     // check for variable initializer
     if( match( TOKEN_EQUAL )) expression(); else emitByte( OP_NIL );
@@ -861,7 +1416,21 @@ static void varDeclaration() {
     defineVariable( global );
 }
 
-static void function( FunctionType type ) {
+// each closure variable is an 'isLocal' byte & an index byte. indexes that don't fit in a byte set bit 1 of 'isLocal'
+//  & take 2 bytes instead
+static void emitClosureVariables( Upvalue* upvalues, int count ) {
+    for( int i = 0; i < count; i++ ) {
+        uint8_t isLocal = upvalues[i].isLocal ? 1 : 0;
+        if( upvalues[i].index > UINT8_MAX ) {
+            emitBytes( isLocal | 2, (upvalues[i].index >> 8) & 0xff );
+            emitByte( upvalues[i].index & 0xff );
+        } else {
+            emitBytes( isLocal, (uint8_t)upvalues[i].index );
+        }
+    }
+}
+
+static ObjFunction* function( FunctionType type ) {
     // creates sub-compiler for this function
     Compiler compiler;
     initCompiler( &compiler, type );
@@ -875,7 +1444,7 @@ static void function( FunctionType type ) {
         do {
             current->function->arity++;
             if( current->function->arity > 255 ) errorAtCurrent( "Cannot have more than 255 parameters." );
-            uint8_t constant = parseVariable( "Expect parameter name." );
+            int constant = parseVariable( "Expect parameter name." );
             defineVariable( constant );
         } while( match( TOKEN_COMMA ) );
     }
@@ -885,48 +1454,58 @@ static void function( FunctionType type ) {
     consume( TOKEN_LEFT_BRACE, "Expect '{' before function body." );
     block();
 
-    // push function onto stack
+    // push function onto stack (functions that capture nothing don't need a closure, so they're just constants)
     ObjFunction* function = endCompiler();
-    emitBytes( OP_CLOSURE, makeConstant( OBJ_VAL( function ) ) );
-
-    // push upvalue info
-    for( int i = 0; i < function->upvalueCount; i++ ) {
-        emitByte( compiler.upvalues[i].isLocal ? 1 : 0 );
-        emitByte( compiler.upvalues[i].index );
+    if( 0 == function->upvalueCount && 0 == function->captureCount ) {
+        emitConstant( OBJ_VAL( function ) );
+        free( compiler.upvalues );
+        free( compiler.captures );
+        return function;
     }
+    emitOperand( OP_CLOSURE, makeConstant( OBJ_VAL( function ) ) );
+
+    // push upvalue info, then by-value capture info
+    emitClosureVariables( compiler.upvalues, function->upvalueCount );
+    emitClosureVariables( compiler.captures, function->captureCount );
+    free( compiler.upvalues );
+    free( compiler.captures );
+    return function;
 }
 
 static void method() {
     // consume the method name as a constant
     consume( TOKEN_IDENTIFIER, "Expect method name." );
-    uint8_t constant = identifierConstant( &parser.previous );
+    Token name = parser.previous;
+    int constant = identifierConstant( &name );
 
     // compile method body as function
     FunctionType type = TYPE_METHOD;
     if( parser.previous.length == 4 && memcmp( parser.previous.start, "init", 4 ) == 0 ) {
         type = TYPE_INITIALIZER;
     }
-    function( type );
+    ObjFunction* compiled = function( type );
+    if( TYPE_METHOD == type && isInlinable( compiled ) ) addCandidate( &currentClass->methods, name, compiled );
 
     // bind function as method to class which is on the stack right above function
     // (i.e. OP_METHOD is a 2-argument operator, taking class & function & binding them, plus a constant for the name)
-    emitBytes( OP_METHOD, constant );
+    emitOperand( OP_METHOD, constant );
 }
 
 static void classDeclaration() {
     // consume class name
     consume( TOKEN_IDENTIFIER, "Expect class name." );
     Token className = parser.previous;
-    uint8_t nameConstant = identifierConstant( &className );
+    int nameConstant = identifierConstant( &className );
 
     // declare class name as a variable pointing to class
     declareVariable();
-    emitBytes( OP_CLASS, nameConstant );
+    emitOperand( OP_CLASS, nameConstant );
     defineVariable( nameConstant );
 
     // allocate classCompiler on stack, and set the global currentClass to it
     ClassCompiler classCompiler;
     classCompiler.hasSuperclass = false;
+    classCompiler.methods = (CandidateList){ 0, 0, NULL };
     classCompiler.enclosing = currentClass;
     currentClass = &classCompiler;
 
@@ -972,16 +1551,24 @@ static void classDeclaration() {
     if( classCompiler.hasSuperclass ) endScope();
     
     // we're done compiling this class, so restore currentClass
+    free( classCompiler.methods.candidates );
     currentClass = currentClass->enclosing;
 }
 
 static void funDeclaration() {
     // declare a variable for the function. mark it initialized b/c it's legal for the function to self-reference
-    uint8_t global = parseVariable( "Expect function name." );
+    int global = parseVariable( "Expect function name." );
+    Token name = parser.previous;
     markInitialized();
     
-    // parse the function body
-    function( TYPE_FUNCTION );
+    // parse the function body (if it's a local, a closure can't copy its value until the function is defined)
+    int local = current->scopeDepth > 0 ? current->localCount - 1 : -1;
+    if( -1 != local ) current->locals[local].isDefining = true;
+    ObjFunction* compiled = function( TYPE_FUNCTION );
+    if( -1 != local ) current->locals[local].isDefining = false;
+
+    // calls to a global function that's never assigned to can be inlined (see emitInline)
+    if( -1 == local && !isAssignedName( &name ) && isInlinable( compiled ) ) addCandidate( &inlineFunctions, name, compiled );
 
     // emit opcode which defines the function based on what's on the stack (which is the function object itself)
     defineVariable( global );
@@ -1000,7 +1587,7 @@ static void declaration() {
 }
 
 // compiles source to chunk
-ObjFunction* compile( const char* source ) {
+static ObjFunction* compileSource( const char* source ) {
     // start scanner
     #ifdef DEBUG_PRINT_SCAN
     printf( "== scanned tokens ==\n" );
@@ -1010,6 +1597,7 @@ ObjFunction* compile( const char* source ) {
     // initialize the compiler
     Compiler compiler;
     initCompiler( &compiler, TYPE_SCRIPT );
+    inlineFunctions.count = 0;
 
     // initialize parser
     parser.hadError = false;
@@ -1020,7 +1608,23 @@ ObjFunction* compile( const char* source ) {
     while( !match( TOKEN_EOF ) ) declaration();
 
     // return the compiled function w/ the name "main"
-    ObjFunction* function = endCompiler();
+    return endCompiler();
+}
+
+ObjFunction* compile( const char* source ) {
+    findAssignedNames( source );
+
+    // almost all code fits in 16-bit forward jumps, so we only pay for 32-bit ones when a jump actually overflows
+    // (the 1st attempt's objects are just garbage once we start over)
+    longJumps = needLongJumps = false;
+    ObjFunction* function = compileSource( source );
+    if( needLongJumps && !parser.hadError ) {
+        longJumps = true;
+        function = compileSource( source );
+    }
+    freeAssignedNames();
+    free( inlineFunctions.candidates );
+    inlineFunctions = (CandidateList){ 0, 0, NULL };
     return parser.hadError ? NULL : function;
 }
 
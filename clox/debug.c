@@ -8,27 +8,40 @@ static size_t simpleInstruction( const char* name, size_t offset ) {
     return offset + 1;
 }
 
-static int jumpInstruction( const char* name, int sign, Chunk* chunk, int offset ) {
-    uint16_t jump = (uint16_t)(chunk->code[offset + 1] << 8);
-    jump |= chunk->code[offset + 2];
-    printf( "%s(%d->%d)", name, offset, offset + 3 + sign * jump );
-    return offset + 3;
+// reads a big-endian operand. OP_WIDE doubles the width of the next instruction's 1st operand (see emitOperand)
+static int readOperand( Chunk* chunk, size_t offset, int width ) {
+    int operand = 0;
+    for( int i = 0; i < width; i++ ) operand = (operand << 8) | chunk->code[offset + i];
+    return operand;
+}
+
+static int jumpInstruction( const char* name, int sign, Chunk* chunk, int offset, bool wide ) {
+    int width = wide ? 4 : 2;
+    int jump = readOperand( chunk, offset + 1, width );
+    printf( "%s(%d->%d)", name, offset, offset + 1 + width + sign * jump );
+    return offset + 1 + width;
+}
+
+static int smallIntInstruction( const char* name, Chunk* chunk, int offset, int size ) {
+    int value = 1 == size ? (int8_t)chunk->code[offset + 1] : (int16_t)((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+    printf( "%s(%d)", name, value );
+    return offset + 1 + size;
 }
 
-static int byteInstruction( const char* name, Chunk* chunk, int offset ) {
+static int byteInstruction( const char* name, Chunk* chunk, int offset, bool wide ) {
     // get the slot that the instruction refers to
-    uint8_t slot = chunk->code[offset + 1];
+    int slot = readOperand( chunk, offset + 1, wide ? 2 : 1 );
     
     // tab over 16 spaces, then print slot index
     printf( "%s(%d)", name, slot );
     
-    // advance code by two bytes
-    return offset + 2; 
+    // advance code past the operand
+    return offset + (wide ? 3 : 2); 
 }
 
-static size_t constantInstruction( const char* name, Chunk* chunk, size_t offset ) {
+static size_t constantInstruction( const char* name, Chunk* chunk, size_t offset, bool wide ) {
     // get constant index
-    uint8_t constantIndex = chunk->code[offset + 1];
+    int constantIndex = readOperand( chunk, offset + 1, wide ? 2 : 1 );
     
     // print constant index
     printf( "%s(", name );
@@ -37,60 +50,102 @@ static size_t constantInstruction( const char* name, Chunk* chunk, size_t offset
     printValue( chunk->constants.values[constantIndex] );
     printf( "@%d)", constantIndex );
 
-    // advance code by two bytes
-    return offset + 2;
+    // advance code past the operand
+    return offset + (wide ? 3 : 2);
 }
 
-static size_t closureInstruction( const char* name, Chunk* chunk, size_t offset ) {
+static size_t closureVariables( Chunk* chunk, size_t offset, int count, const char* local, const char* enclosing ) {
+    for( int i = 0; i < count; i++ ) {
+        size_t start = offset;
+        int isLocal = chunk->code[offset++];
+        int index = readOperand( chunk, offset, isLocal & 2 ? 2 : 1 );
+        offset += isLocal & 2 ? 2 : 1;
+        printf( "\n%04zu | %s %04d", start, isLocal & 1 ? local : enclosing, index );
+    }
+    return offset;
+}
+
+static size_t closureInstruction( const char* name, Chunk* chunk, size_t offset, bool wide ) {
     // print the closure
-    offset++;
-    int8_t constant = chunk->code[offset++];
+    int constant = readOperand( chunk, offset + 1, wide ? 2 : 1 );
+    offset += wide ? 3 : 2;
     printf( "OP_CLOSURE(" );
     printValue( chunk->constants.values[constant] );
     printf( "@%d)", constant );
 
-    // print the upvalues
+    // print the upvalues, then the captured values
     ObjFunction* function = AS_FUNCTION( chunk->constants.values[constant] );
-    for( int i = 0; i < function->upvalueCount; i++ ) {
-        int isLocal = chunk->code[offset++];
-        int index = chunk->code[offset++];
-        printf( "\n%04zu | %s %04d", offset - 2, isLocal ? "local" : "upvalue", index );
-    }
-    return offset;
+    offset = closureVariables( chunk, offset, function->upvalueCount, "local", "upvalue" );
+    return closureVariables( chunk, offset, function->captureCount, "copy local", "copy capture" );
 }
 
-static int invokeInstruction( const char* name, Chunk* chunk, int offset ) {
-    uint8_t constant = chunk->code[offset + 1];
+static int invokeInstruction( const char* name, Chunk* chunk, int offset, bool wide ) {
+    int constant = readOperand( chunk, offset + 1, wide ? 2 : 1 );
+    offset += wide ? 1 : 0;
     uint8_t argCount = chunk->code[offset + 2];
-    printf( "%-16s (%d args) %4d '", name, argCount, constant );
+    uint8_t slot = chunk->code[offset + 3];
+    printf( "%-16s (%d args, slot %d) %4d '", name, argCount, slot, constant );
     printValue( chunk->constants.values[constant] );
     printf( "'\n" );
-    return offset + 3;
+    return offset + 4;
 }
 
-size_t disassembleInstruction( Chunk* chunk, size_t offset ) {
-    // print instruction offset & line number
-    printf( "%04zu %04d ", offset, chunk->lines[offset] );
+// the jump is the 1st operand (so OP_WIDE widens it), then the inlined function & arg count (& a cached slot)
+static size_t guardInstruction( const char* name, Chunk* chunk, size_t offset, bool wide, bool hasSlot ) {
+    int width = wide ? 4 : 2;
+    int jump = readOperand( chunk, offset + 1, width );
+    int constant = readOperand( chunk, offset + 1 + width, 2 );
+    printf( "%s(", name );
+    printValue( chunk->constants.values[constant] );
+    printf( "@%d, %d args, %zu->%zu)", constant, chunk->code[offset + 3 + width], offset, offset + 1 + width + jump );
+    return offset + 1 + width + 3 + (hasSlot ? 1 : 0);
+}
 
+// the jump is the 1st operand (so OP_WIDE widens it), then the counter & limit slots (or the limit's constant)
+static size_t countedInstruction( const char* name, int sign, Chunk* chunk, size_t offset, bool wide ) {
+    int width = wide ? 4 : 2;
+    int jump = readOperand( chunk, offset + 1, width ), limit = chunk->code[offset + 2 + width];
+    printf( "%s(%d < ", name, chunk->code[offset + 1 + width] );
+    if( OP_FOR_PREP_CONSTANT == chunk->code[offset] || OP_FOR_LOOP_CONSTANT == chunk->code[offset] ) {
+        printValue( chunk->constants.values[limit] );
+        printf( "@%d", limit );
+    } else printf( "%d", limit );
+    printf( ", %zu->%zu)", offset, offset + 1 + width + sign * jump );
+    return offset + 1 + width + 2;
+}
+
+static size_t hoistedInstruction( const char* name, Chunk* chunk, size_t offset ) {
+    int slot = chunk->code[offset + 1], constant = chunk->code[offset + 2];
+    printf( "%s(%d, ", name, slot );
+    printValue( chunk->constants.values[constant] );
+    printf( "@%d)", constant );
+    return offset + 3;
+}
+
+static size_t decodeInstruction( Chunk* chunk, size_t offset, bool wide ) {
     // get instruction
     uint8_t instruction = chunk->code[offset];
 
     // dispatch on instruction
     switch( instruction ) {
-        case OP_CONSTANT:       return constantInstruction( "OP_CONSTANT", chunk, offset );
+        case OP_CONSTANT:       return constantInstruction( "OP_CONSTANT", chunk, offset, wide );
+        case OP_SMALLINT:       return smallIntInstruction( "OP_SMALLINT", chunk, offset, 1 );
+        case OP_SMALLINT_16:    return smallIntInstruction( "OP_SMALLINT_16", chunk, offset, 2 );
         case OP_NIL:            return simpleInstruction( "OP_NIL", offset );
         case OP_TRUE:           return simpleInstruction( "OP_TRUE", offset );
         case OP_FALSE:          return simpleInstruction( "OP_FALSE", offset );
         case OP_POP:            return simpleInstruction( "OP_POP", offset );
-        case OP_DEFINE_GLOBAL:  return constantInstruction( "OP_DEFINE_GLOBAL", chunk, offset );
-        case OP_GET_GLOBAL:     return constantInstruction( "OP_GET_GLOBAL", chunk, offset );
-        case OP_SET_GLOBAL:     return constantInstruction( "OP_SET_GLOBAL", chunk, offset );
-        case OP_GET_UPVALUE:    return byteInstruction( "OP_GET_UPVALUE", chunk, offset );
-        case OP_SET_UPVALUE:    return byteInstruction( "OP_SET_UPVALUE", chunk, offset );
-        case OP_GET_LOCAL:      return byteInstruction( "OP_GET_LOCAL", chunk, offset );
-        case OP_SET_LOCAL:      return byteInstruction( "OP_SET_LOCAL", chunk, offset );
-        case OP_GET_PROPERTY:   return constantInstruction( "OP_GET_PROPERTY", chunk, offset );
-        case OP_SET_PROPERTY:   return constantInstruction( "OP_SET_PROPERTY", chunk, offset );
+        case OP_POPN:           return byteInstruction( "OP_POPN", chunk, offset, false );
+        case OP_DEFINE_GLOBAL:  return constantInstruction( "OP_DEFINE_GLOBAL", chunk, offset, wide );
+        case OP_GET_GLOBAL:     return constantInstruction( "OP_GET_GLOBAL", chunk, offset, wide );
+        case OP_SET_GLOBAL:     return constantInstruction( "OP_SET_GLOBAL", chunk, offset, wide );
+        case OP_GET_UPVALUE:    return byteInstruction( "OP_GET_UPVALUE", chunk, offset, wide );
+        case OP_SET_UPVALUE:    return byteInstruction( "OP_SET_UPVALUE", chunk, offset, wide );
+        case OP_GET_CAPTURE:    return byteInstruction( "OP_GET_CAPTURE", chunk, offset, wide );
+        case OP_GET_LOCAL:      return byteInstruction( "OP_GET_LOCAL", chunk, offset, wide );
+        case OP_SET_LOCAL:      return byteInstruction( "OP_SET_LOCAL", chunk, offset, wide );
+        case OP_GET_PROPERTY:   return constantInstruction( "OP_GET_PROPERTY", chunk, offset, wide );
+        case OP_SET_PROPERTY:   return constantInstruction( "OP_SET_PROPERTY", chunk, offset, wide );
         case OP_EQUAL:          return simpleInstruction( "OP_EQUAL", offset );
         case OP_GREATER:        return simpleInstruction( "OP_GREATER", offset );
         case OP_LESS:           return simpleInstruction( "OP_LESS", offset );
@@ -100,26 +155,55 @@ size_t disassembleInstruction( Chunk* chunk, size_t offset ) {
         case OP_DIVIDE:         return simpleInstruction( "OP_DIVIDE", offset );
         case OP_NOT:            return simpleInstruction( "OP_NOT", offset );
         case OP_NEGATE:         return simpleInstruction( "OP_NEGATE", offset );
+        case OP_ADD_NUM:        return simpleInstruction( "OP_ADD_NUM", offset );
+        case OP_SUBTRACT_NUM:   return simpleInstruction( "OP_SUBTRACT_NUM", offset );
+        case OP_MULTIPLY_NUM:   return simpleInstruction( "OP_MULTIPLY_NUM", offset );
+        case OP_DIVIDE_NUM:     return simpleInstruction( "OP_DIVIDE_NUM", offset );
+        case OP_GREATER_NUM:    return simpleInstruction( "OP_GREATER_NUM", offset );
+        case OP_LESS_NUM:       return simpleInstruction( "OP_LESS_NUM", offset );
+        case OP_NEGATE_NUM:     return simpleInstruction( "OP_NEGATE_NUM", offset );
         case OP_PRINT:          return simpleInstruction( "OP_PRINT", offset );
-        case OP_JUMP:           return jumpInstruction( "OP_JUMP", 1, chunk, offset );
-        case OP_JUMP_IF_FALSE:  return jumpInstruction( "OP_JUMP_IF_FALSE", 1, chunk, offset );
-        case OP_LOOP:           return jumpInstruction( "OP_LOOP", -1, chunk, offset );
-        case OP_CALL:           return byteInstruction( "OP_CALL", chunk, offset );
-        case OP_INVOKE:         return invokeInstruction( "OP_INVOKE", chunk, offset );
-        case OP_CLOSURE:        return closureInstruction( "OP_CLOSURE", chunk, offset );
+        case OP_JUMP:           return jumpInstruction( "OP_JUMP", 1, chunk, offset, wide );
+        case OP_JUMP_IF_FALSE:  return jumpInstruction( "OP_JUMP_IF_FALSE", 1, chunk, offset, wide );
+        case OP_LOOP:           return jumpInstruction( "OP_LOOP", -1, chunk, offset, wide );
+        case OP_CALL:           return byteInstruction( "OP_CALL", chunk, offset, false );
+        case OP_INVOKE:         return invokeInstruction( "OP_INVOKE", chunk, offset, wide );
+        case OP_CLOSURE:        return closureInstruction( "OP_CLOSURE", chunk, offset, wide );
         case OP_CLOSE_UPVALUE:  return simpleInstruction("OP_CLOSE_UPVALUE", offset);
         case OP_RETURN:         return simpleInstruction( "OP_RETURN", offset );
-        case OP_CLASS:          return constantInstruction( "OP_CLASS", chunk, offset );
-        case OP_METHOD:         return constantInstruction( "OP_METHOD", chunk, offset );
+        case OP_CLASS:          return constantInstruction( "OP_CLASS", chunk, offset, wide );
+        case OP_METHOD:         return constantInstruction( "OP_METHOD", chunk, offset, wide );
         case OP_INHERIT:        return simpleInstruction( "OP_INHERIT", offset );
-        case OP_GET_SUPER:      return constantInstruction( "OP_GET_SUPER", chunk, offset );
-        case OP_SUPER_INVOKE:   return invokeInstruction( "OP_SUPER_INVOKE", chunk, offset );
+        case OP_GET_SUPER:      return constantInstruction( "OP_GET_SUPER", chunk, offset, wide );
+        case OP_SUPER_INVOKE:   return invokeInstruction( "OP_SUPER_INVOKE", chunk, offset, wide );
+        case OP_ARRAY:          return byteInstruction( "OP_ARRAY", chunk, offset, false );
+        case OP_GET_INDEX:      return simpleInstruction( "OP_GET_INDEX", offset );
+        case OP_SET_INDEX:      return simpleInstruction( "OP_SET_INDEX", offset );
+        case OP_GUARD_CALL:     return guardInstruction( "OP_GUARD_CALL", chunk, offset, wide, false );
+        case OP_GUARD_INVOKE:   return guardInstruction( "OP_GUARD_INVOKE", chunk, offset, wide, true );
+        case OP_PEEK:           return byteInstruction( "OP_PEEK", chunk, offset, false );
+        case OP_INLINE_RETURN:  return byteInstruction( "OP_INLINE_RETURN", chunk, offset, false );
+        case OP_HOIST_GLOBAL:   return constantInstruction( "OP_HOIST_GLOBAL", chunk, offset, false );
+        case OP_HOIST_FIELD:    return constantInstruction( "OP_HOIST_FIELD", chunk, offset, false );
+        case OP_GET_HOISTED_GLOBAL: return hoistedInstruction( "OP_GET_HOISTED_GLOBAL", chunk, offset );
+        case OP_GET_HOISTED_FIELD:  return hoistedInstruction( "OP_GET_HOISTED_FIELD", chunk, offset );
+        case OP_FOR_PREP:       return countedInstruction( "OP_FOR_PREP", 1, chunk, offset, wide );
+        case OP_FOR_LOOP:       return countedInstruction( "OP_FOR_LOOP", -1, chunk, offset, wide );
+        case OP_FOR_PREP_CONSTANT: return countedInstruction( "OP_FOR_PREP_CONSTANT", 1, chunk, offset, wide );
+        case OP_FOR_LOOP_CONSTANT: return countedInstruction( "OP_FOR_LOOP_CONSTANT", -1, chunk, offset, wide );
+        case OP_WIDE:           printf( "OP_WIDE " ); return decodeInstruction( chunk, offset + 1, true );
         default:
             printf( "Unknown opcode %d", instruction );
             return offset + 1;
     }
 }
 
+size_t disassembleInstruction( Chunk* chunk, size_t offset ) {
+    // print instruction offset & line number
+    printf( "%04zu %04d ", offset, getLine( chunk, offset ) );
+    return decodeInstruction( chunk, offset, false );
+}
+
 void disassembleChunk( Chunk* chunk ) {
     for( size_t offset = 0; offset < chunk->count; ) {
         offset = disassembleInstruction( chunk, offset );
@@ -0,0 +1,220 @@
+#include "f64.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define F64_X86
+#include <immintrin.h>
+#endif
+
+F64Kernels f64;
+
+// -- SCALAR --
+
+static double sumScalar( const double* x, size_t n ) {
+    double s = 0;
+    for( size_t i = 0; i < n; i++ ) s += x[i];
+    return s;
+}
+
+static double dotScalar( const double* x, const double* y, size_t n ) {
+    double s = 0;
+    for( size_t i = 0; i < n; i++ ) s += x[i] * y[i];
+    return s;
+}
+
+static double minScalar( const double* x, size_t n ) {
+    double m = x[0];
+    for( size_t i = 1; i < n; i++ ) if( x[i] < m ) m = x[i];
+    return m;
+}
+
+static double maxScalar( const double* x, size_t n ) {
+    double m = x[0];
+    for( size_t i = 1; i < n; i++ ) if( x[i] > m ) m = x[i];
+    return m;
+}
+
+static void axpyScalar( double a, const double* x, double* y, size_t n ) {
+    for( size_t i = 0; i < n; i++ ) y[i] += a * x[i];
+}
+
+static void scaleScalar( double a, double* x, size_t n ) {
+    for( size_t i = 0; i < n; i++ ) x[i] *= a;
+}
+
+static void addScalar( double* dst, const double* x, const double* y, size_t n ) {
+    for( size_t i = 0; i < n; i++ ) dst[i] = x[i] + y[i];
+}
+
+static void mulScalar( double* dst, const double* x, const double* y, size_t n ) {
+    for( size_t i = 0; i < n; i++ ) dst[i] = x[i] * y[i];
+}
+
+#ifdef F64_X86
+
+// -- SSE2 (2 lanes) --
+// each kernel runs the vector loop, then finishes the tail w/ scalar code
+
+#define SSE2 __attribute__((target("sse2")))
+
+SSE2 static double hsum128( __m128d v ) { return _mm_cvtsd_f64( _mm_add_sd( v, _mm_unpackhi_pd( v, v ) ) ); }
+
+SSE2 static double sumSSE2( const double* x, size_t n ) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 ) {
+        s0 = _mm_add_pd( s0, _mm_loadu_pd( x + i ) );
+        s1 = _mm_add_pd( s1, _mm_loadu_pd( x + i + 2 ) );
+    }
+    return hsum128( _mm_add_pd( s0, s1 ) ) + sumScalar( x + i, n - i );
+}
+
+SSE2 static double dotSSE2( const double* x, const double* y, size_t n ) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 ) {
+        s0 = _mm_add_pd( s0, _mm_mul_pd( _mm_loadu_pd( x + i ), _mm_loadu_pd( y + i ) ) );
+        s1 = _mm_add_pd( s1, _mm_mul_pd( _mm_loadu_pd( x + i + 2 ), _mm_loadu_pd( y + i + 2 ) ) );
+    }
+    return hsum128( _mm_add_pd( s0, s1 ) ) + dotScalar( x + i, y + i, n - i );
+}
+
+SSE2 static double minSSE2( const double* x, size_t n ) {
+    if( n < 2 ) return minScalar( x, n );
+    __m128d m = _mm_loadu_pd( x );
+    size_t i = 2;
+    for( ; i + 2 <= n; i += 2 ) m = _mm_min_pd( m, _mm_loadu_pd( x + i ) );
+    double r = _mm_cvtsd_f64( _mm_min_sd( m, _mm_unpackhi_pd( m, m ) ) );
+    for( ; i < n; i++ ) if( x[i] < r ) r = x[i];
+    return r;
+}
+
+SSE2 static double maxSSE2( const double* x, size_t n ) {
+    if( n < 2 ) return maxScalar( x, n );
+    __m128d m = _mm_loadu_pd( x );
+    size_t i = 2;
+    for( ; i + 2 <= n; i += 2 ) m = _mm_max_pd( m, _mm_loadu_pd( x + i ) );
+    double r = _mm_cvtsd_f64( _mm_max_sd( m, _mm_unpackhi_pd( m, m ) ) );
+    for( ; i < n; i++ ) if( x[i] > r ) r = x[i];
+    return r;
+}
+
+SSE2 static void axpySSE2( double a, const double* x, double* y, size_t n ) {
+    __m128d va = _mm_set1_pd( a );
+    size_t i = 0;
+    for( ; i + 2 <= n; i += 2 ) _mm_storeu_pd( y + i, _mm_add_pd( _mm_loadu_pd( y + i ), _mm_mul_pd( va, _mm_loadu_pd( x + i ) ) ) );
+    axpyScalar( a, x + i, y + i, n - i );
+}
+
+SSE2 static void scaleSSE2( double a, double* x, size_t n ) {
+    __m128d va = _mm_set1_pd( a );
+    size_t i = 0;
+    for( ; i + 2 <= n; i += 2 ) _mm_storeu_pd( x + i, _mm_mul_pd( va, _mm_loadu_pd( x + i ) ) );
+    scaleScalar( a, x + i, n - i );
+}
+
+SSE2 static void addSSE2( double* dst, const double* x, const double* y, size_t n ) {
+    size_t i = 0;
+    for( ; i + 2 <= n; i += 2 ) _mm_storeu_pd( dst + i, _mm_add_pd( _mm_loadu_pd( x + i ), _mm_loadu_pd( y + i ) ) );
+    addScalar( dst + i, x + i, y + i, n - i );
+}
+
+SSE2 static void mulSSE2( double* dst, const double* x, const double* y, size_t n ) {
+    size_t i = 0;
+    for( ; i + 2 <= n; i += 2 ) _mm_storeu_pd( dst + i, _mm_mul_pd( _mm_loadu_pd( x + i ), _mm_loadu_pd( y + i ) ) );
+    mulScalar( dst + i, x + i, y + i, n - i );
+}
+
+// -- AVX2 (4 lanes) --
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static double hsum256( __m256d v ) {
+    __m128d lo = _mm256_castpd256_pd128( v ), hi = _mm256_extractf128_pd( v, 1 );
+    lo = _mm_add_pd( lo, hi );
+    return _mm_cvtsd_f64( _mm_add_sd( lo, _mm_unpackhi_pd( lo, lo ) ) );
+}
+
+AVX2 static double sumAVX2( const double* x, size_t n ) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for( ; i + 8 <= n; i += 8 ) {
+        s0 = _mm256_add_pd( s0, _mm256_loadu_pd( x + i ) );
+        s1 = _mm256_add_pd( s1, _mm256_loadu_pd( x + i + 4 ) );
+    }
+    return hsum256( _mm256_add_pd( s0, s1 ) ) + sumScalar( x + i, n - i );
+}
+
+AVX2 static double dotAVX2( const double* x, const double* y, size_t n ) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for( ; i + 8 <= n; i += 8 ) {
+        s0 = _mm256_add_pd( s0, _mm256_mul_pd( _mm256_loadu_pd( x + i ), _mm256_loadu_pd( y + i ) ) );
+        s1 = _mm256_add_pd( s1, _mm256_mul_pd( _mm256_loadu_pd( x + i + 4 ), _mm256_loadu_pd( y + i + 4 ) ) );
+    }
+    return hsum256( _mm256_add_pd( s0, s1 ) ) + dotScalar( x + i, y + i, n - i );
+}
+
+AVX2 static double minAVX2( const double* x, size_t n ) {
+    if( n < 4 ) return minScalar( x, n );
+    __m256d m = _mm256_loadu_pd( x );
+    size_t i = 4;
+    for( ; i + 4 <= n; i += 4 ) m = _mm256_min_pd( m, _mm256_loadu_pd( x + i ) );
+    __m128d h = _mm_min_pd( _mm256_castpd256_pd128( m ), _mm256_extractf128_pd( m, 1 ) );
+    double r = _mm_cvtsd_f64( _mm_min_sd( h, _mm_unpackhi_pd( h, h ) ) );
+    for( ; i < n; i++ ) if( x[i] < r ) r = x[i];
+    return r;
+}
+
+AVX2 static double maxAVX2( const double* x, size_t n ) {
+    if( n < 4 ) return maxScalar( x, n );
+    __m256d m = _mm256_loadu_pd( x );
+    size_t i = 4;
+    for( ; i + 4 <= n; i += 4 ) m = _mm256_max_pd( m, _mm256_loadu_pd( x + i ) );
+    __m128d h = _mm_max_pd( _mm256_castpd256_pd128( m ), _mm256_extractf128_pd( m, 1 ) );
+    double r = _mm_cvtsd_f64( _mm_max_sd( h, _mm_unpackhi_pd( h, h ) ) );
+    for( ; i < n; i++ ) if( x[i] > r ) r = x[i];
+    return r;
+}
+
+AVX2 static void axpyAVX2( double a, const double* x, double* y, size_t n ) {
+    __m256d va = _mm256_set1_pd( a );
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 ) _mm256_storeu_pd( y + i, _mm256_add_pd( _mm256_loadu_pd( y + i ), _mm256_mul_pd( va, _mm256_loadu_pd( x + i ) ) ) );
+    axpyScalar( a, x + i, y + i, n - i );
+}
+
+AVX2 static void scaleAVX2( double a, double* x, size_t n ) {
+    __m256d va = _mm256_set1_pd( a );
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 ) _mm256_storeu_pd( x + i, _mm256_mul_pd( va, _mm256_loadu_pd( x + i ) ) );
+    scaleScalar( a, x + i, n - i );
+}
+
+AVX2 static void addAVX2( double* dst, const double* x, const double* y, size_t n ) {
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 ) _mm256_storeu_pd( dst + i, _mm256_add_pd( _mm256_loadu_pd( x + i ), _mm256_loadu_pd( y + i ) ) );
+    addScalar( dst + i, x + i, y + i, n - i );
+}
+
+AVX2 static void mulAVX2( double* dst, const double* x, const double* y, size_t n ) {
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 ) _mm256_storeu_pd( dst + i, _mm256_mul_pd( _mm256_loadu_pd( x + i ), _mm256_loadu_pd( y + i ) ) );
+    mulScalar( dst + i, x + i, y + i, n - i );
+}
+
+#endif
+
+void initF64Kernels() {
+    #ifdef F64_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) ) {
+        f64 = (F64Kernels){ "avx2", sumAVX2, dotAVX2, minAVX2, maxAVX2, axpyAVX2, scaleAVX2, addAVX2, mulAVX2 };
+        return;
+    }
+    if( __builtin_cpu_supports( "sse2" ) ) {
+        f64 = (F64Kernels){ "sse2", sumSSE2, dotSSE2, minSSE2, maxSSE2, axpySSE2, scaleSSE2, addSSE2, mulSSE2 };
+        return;
+    }
+    #endif
+    f64 = (F64Kernels){ "scalar", sumScalar, dotScalar, minScalar, maxScalar, axpyScalar, scaleScalar, addScalar, mulScalar };
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "common.h"
+
+// bulk kernels over unboxed double buffers (used by the Float64Array natives)
+// initF64Kernels picks the widest instruction set the host supports (AVX2, SSE2, or plain scalar code)
+typedef struct {
+    const char* name; // instruction set in use
+    double (*sum)( const double* x, size_t n );
+    double (*dot)( const double* x, const double* y, size_t n );
+    double (*min)( const double* x, size_t n ); // n must be > 0
+    double (*max)( const double* x, size_t n ); // n must be > 0
+    void (*axpy)( double a, const double* x, double* y, size_t n ); // y = a * x + y
+    void (*scale)( double a, double* x, size_t n ); // x = a * x
+    void (*add)( double* dst, const double* x, const double* y, size_t n ); // dst = x + y
+    void (*mul)( double* dst, const double* x, const double* y, size_t n ); // dst = x * y
+} F64Kernels;
+
+extern F64Kernels f64;
+
+void initF64Kernels();
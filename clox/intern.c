@@ -0,0 +1,91 @@
+#include <string.h>
+#include "intern.h"
+#include "memory.h"
+#include "object.h"
+
+#define SLOT_EMPTY      ((uint64_t)0)
+#define SLOT_TOMBSTONE  ((uint64_t)1)
+#define SLOT_PTR_MASK   ((uint64_t)0x0000ffffffffffff)
+#define SLOT_TAG(hash)  ((uint64_t)((hash) >> 16) << 48)
+
+static inline uint64_t makeSlot( ObjString* string ) { return SLOT_TAG( string->hash ) | (uint64_t)(uintptr_t)string; }
+static inline ObjString* slotString( uint64_t slot ) { return (ObjString*)(uintptr_t)(slot & SLOT_PTR_MASK); }
+
+void initStringSet( StringSet* set ) {
+    set->load = 0;
+    set->capacity = 0;
+    set->slots = NULL;
+}
+
+void freeStringSet( StringSet* set ) {
+    freeArray( sizeof( uint64_t ), set->slots, set->capacity );
+    initStringSet( set );
+}
+
+// finds the slot to insert a string with this hash into (the 1st tombstone or empty slot we hit)
+// note: only valid for strings that aren't already in the set
+static uint64_t* findFreeSlot( uint64_t* slots, size_t capacity, uint32_t hash ) {
+    for( size_t i = hash & (capacity - 1);; i = (i + 1) & (capacity - 1) ) {
+        if( slots[i] <= SLOT_TOMBSTONE ) return &slots[i];
+    }
+}
+
+static void adjustCapacity( StringSet* set, size_t newCapacity ) {
+    // allocate new (empty) slots
+    uint64_t* newSlots = zallocate( sizeof( uint64_t ) * newCapacity );
+
+    // re-insert live strings (dropping tombstones)
+    size_t newLoad = 0;
+    for( size_t i = 0; i < set->capacity; i++ ) {
+        uint64_t slot = set->slots[i];
+        if( slot <= SLOT_TOMBSTONE ) continue;
+        *findFreeSlot( newSlots, newCapacity, slotString( slot )->hash ) = slot;
+        newLoad++;
+    }
+
+    // swap buffers
+    freeArray( sizeof( uint64_t ), set->slots, set->capacity );
+    set->load = newLoad;
+    set->capacity = newCapacity;
+    set->slots = newSlots;
+}
+
+void stringSetAdd( StringSet* set, ObjString* string ) {
+    // grow the set if we exceed our max load
+    if( set->load + 1 > set->capacity * STRING_SET_MAX_LOAD )
+        adjustCapacity( set, growCapacity( set->capacity ) );
+
+    // only bump the load if we aren't reusing a tombstone
+    uint64_t* slot = findFreeSlot( set->slots, set->capacity, string->hash );
+    if( SLOT_EMPTY == *slot ) set->load++;
+    *slot = makeSlot( string );
+}
+
+ObjString* stringSetFind( StringSet* set, uint32_t hash, const char* s1, size_t len1, const char* s2, size_t len2 ) {
+    // avoid null pointer access
+    if( 0 == set->load ) return NULL;
+
+    // linear probing: only dereference strings whose hash tag matches
+    size_t len = len1 + len2;
+    uint64_t tag = SLOT_TAG( hash );
+    for( size_t i = hash & (set->capacity - 1);; i = (i + 1) & (set->capacity - 1) ) {
+        uint64_t slot = set->slots[i];
+        if( SLOT_EMPTY == slot ) return NULL;
+        if( (slot & ~SLOT_PTR_MASK) != tag || SLOT_TOMBSTONE == slot ) continue;
+
+        // tag matched, so check the string itself
+        ObjString* string = slotString( slot );
+        if( string->hash == hash &&
+            string->len == len &&
+            0 == memcmp( string->buf, s1, len1 ) &&
+            0 == memcmp( string->buf + len1, s2, len2 ) )
+            return string;
+    }
+}
+
+void stringSetRemoveWhite( StringSet* set ) {
+    for( size_t i = 0; i < set->capacity; i++ ) {
+        uint64_t slot = set->slots[i];
+        if( slot > SLOT_TOMBSTONE && !slotString( slot )->obj.isMarked ) set->slots[i] = SLOT_TOMBSTONE;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "common.h"
+#include "value.h"
+
+#define STRING_SET_MAX_LOAD 0.75
+
+// weak hash set used to intern strings (vm.strings)
+// each slot packs an ObjString pointer (low 48 bits) together with the top 16 bits of its hash (high 16 bits),
+//  so probing past a non-matching slot almost never has to dereference the string itself
+// like Table, this uses open addressing w/ linear probing. an empty slot is 0, a tombstone is 1
+typedef struct {
+    size_t load, capacity; // load = # of used slots (including tombstones)
+    uint64_t* slots;
+} StringSet;
+
+void initStringSet( StringSet* set );
+void freeStringSet( StringSet* set );
+void stringSetAdd( StringSet* set, ObjString* string );
+ObjString* stringSetFind( StringSet* set, uint32_t hash, const char* s1, size_t len1, const char* s2, size_t len2 );
+void stringSetRemoveWhite( StringSet* set ); // removes every unmarked string (call after marking, before sweeping)
@@ -0,0 +1,301 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ir.h"
+#include "object.h"
+#include "memory.h"
+
+// -- DECODING --
+
+static bool isGuard( uint8_t op ) { return OP_GUARD_CALL == op || OP_GUARD_INVOKE == op; }
+static int guardLength( uint8_t op ) { return OP_GUARD_INVOKE == op ? 4 : 3; } // operand bytes after the jump
+static bool isCounted( uint8_t op ) { // (2 bytes after the jump)
+    return OP_FOR_PREP == op || OP_FOR_LOOP == op || OP_FOR_PREP_CONSTANT == op || OP_FOR_LOOP_CONSTANT == op;
+}
+
+// returns the length of the instruction at 'offset' (including any OP_WIDE prefix), or 0 if it can't be decoded
+static size_t instructionLength( Chunk* chunk, size_t offset ) {
+    bool wide = OP_WIDE == chunk->code[offset];
+    size_t start = offset + (wide ? 1 : 0), width = wide ? 2 : 1;
+    if( start >= chunk->count ) return 0;
+    switch( chunk->code[start] ) {
+        case OP_NIL: case OP_TRUE: case OP_FALSE: case OP_POP: case OP_EQUAL: case OP_GREATER: case OP_LESS:
+        case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY: case OP_DIVIDE: case OP_NOT: case OP_NEGATE: case OP_PRINT:
+        case OP_CLOSE_UPVALUE: case OP_RETURN: case OP_INHERIT: case OP_GET_INDEX: case OP_SET_INDEX:
+        case OP_ADD_NUM: case OP_SUBTRACT_NUM: case OP_MULTIPLY_NUM: case OP_DIVIDE_NUM: case OP_GREATER_NUM:
+        case OP_LESS_NUM: case OP_NEGATE_NUM:
+            return wide ? 0 : 1;
+        case OP_SMALLINT: case OP_CALL: case OP_ARRAY: case OP_POPN: case OP_PEEK: case OP_INLINE_RETURN:
+        case OP_HOIST_GLOBAL: case OP_HOIST_FIELD:
+            return wide ? 0 : 2;
+        case OP_SMALLINT_16: case OP_GET_HOISTED_GLOBAL: case OP_GET_HOISTED_FIELD:
+            return wide ? 0 : 3;
+        case OP_CONSTANT: case OP_DEFINE_GLOBAL: case OP_GET_GLOBAL: case OP_SET_GLOBAL: case OP_GET_LOCAL:
+        case OP_SET_LOCAL: case OP_GET_UPVALUE: case OP_SET_UPVALUE: case OP_GET_CAPTURE: case OP_GET_PROPERTY:
+        case OP_SET_PROPERTY: case OP_CLASS: case OP_METHOD: case OP_GET_SUPER:
+            return start - offset + 1 + width;
+        case OP_JUMP: case OP_JUMP_IF_FALSE: case OP_LOOP:
+            return start - offset + 1 + (wide ? 4 : 2);
+        case OP_GUARD_CALL: case OP_GUARD_INVOKE:
+            return start - offset + 1 + (wide ? 4 : 2) + guardLength( chunk->code[start] );
+        case OP_FOR_PREP: case OP_FOR_LOOP: case OP_FOR_PREP_CONSTANT: case OP_FOR_LOOP_CONSTANT:
+            return start - offset + 1 + (wide ? 4 : 2) + 2;
+        case OP_INVOKE: case OP_SUPER_INVOKE:
+            return start - offset + 1 + width + 2; // + arg count & cached slot
+        case OP_CLOSURE: {
+            // the closure's variables follow the constant, each w/ a 1 or 2 byte index (see emitClosureVariables)
+            int constant = wide ? (chunk->code[start + 1] << 8) | chunk->code[start + 2] : chunk->code[start + 1];
+            ObjFunction* function = AS_FUNCTION( chunk->constants.values[constant] );
+            size_t end = start + 1 + width;
+            for( int i = 0; i < function->upvalueCount + function->captureCount && end < chunk->count; i++ ) end += chunk->code[end] & 2 ? 3 : 2;
+            return end - offset;
+        }
+        default:
+            return 0;
+    }
+}
+
+static bool isJump( uint8_t op ) { return OP_JUMP == op || OP_JUMP_IF_FALSE == op || OP_LOOP == op || isGuard( op ) || isCounted( op ); }
+
+// -- HELPERS --
+
+uint8_t* irOperands( IRFunction* ir, IRInstruction* instruction ) { return ir->bytes + instruction->operands; }
+
+IRInstruction irInstruction( IRFunction* ir, uint8_t op, bool wide, const uint8_t* operands, int length, int line ) {
+    if( ir->byteCount + length > ir->byteCapacity ) {
+        ir->byteCapacity = (ir->byteCount + length) * 2;
+        ir->bytes = (uint8_t*)realloc( ir->bytes, ir->byteCapacity );
+        if( NULL == ir->bytes ) exit( 1 );
+    }
+    memcpy( ir->bytes + ir->byteCount, operands, length );
+    IRInstruction instruction = { op, wide, line, ir->byteCount, length, -1 };
+    ir->byteCount += length;
+    return instruction;
+}
+
+int irOperand( IRFunction* ir, IRInstruction* instruction ) {
+    uint8_t* operands = irOperands( ir, instruction );
+    return instruction->wide ? (operands[0] << 8) | operands[1] : operands[0];
+}
+
+int nextLiveBlock( IRFunction* ir, int block ) {
+    for( block++; block < ir->blockCount; block++ ) if( ir->blocks[block].isLive ) return block;
+    return -1;
+}
+
+int insertBlock( IRFunction* ir, int at ) {
+    ir->blocks = (IRBlock*)realloc( ir->blocks, sizeof( IRBlock ) * (ir->blockCount + 1) );
+    if( NULL == ir->blocks ) exit( 1 );
+    memmove( ir->blocks + at + 1, ir->blocks + at, sizeof( IRBlock ) * (ir->blockCount - at) );
+    ir->blockCount++;
+    memset( &ir->blocks[at], 0, sizeof( IRBlock ) );
+    ir->blocks[at].isLive = true;
+    ir->blocks[at].exit = EXIT_FALLTHROUGH;
+    for( int b = 0; b < ir->blockCount; b++ ) {
+        IRBlock* block = &ir->blocks[b];
+        if( b != at && (EXIT_JUMP == block->exit || EXIT_BRANCH == block->exit) && block->target >= at ) block->target++;
+    }
+    return at;
+}
+
+static void appendInstruction( IRBlock* block, IRInstruction instruction ) {
+    if( block->count + 1 > block->capacity ) {
+        block->capacity = block->capacity < 8 ? 8 : block->capacity * 2;
+        block->code = (IRInstruction*)realloc( block->code, sizeof( IRInstruction ) * block->capacity );
+        if( NULL == block->code ) exit( 1 );
+    }
+    block->code[block->count++] = instruction;
+}
+
+// -- LIFTING --
+
+// jumps count from the end of their offset (which is the end of the instruction, except for guards & counted loops)
+static size_t jumpTarget( Chunk* chunk, size_t offset ) {
+    bool wide = OP_WIDE == chunk->code[offset];
+    uint8_t* operand = chunk->code + offset + (wide ? 2 : 1);
+    size_t jump = wide ? ((size_t)operand[0] << 24) | ((size_t)operand[1] << 16) | ((size_t)operand[2] << 8) | operand[3] :
+                         ((size_t)operand[0] << 8) | operand[1];
+    size_t end = offset + (wide ? 6 : 3);
+    uint8_t op = chunk->code[offset + (wide ? 1 : 0)];
+    if( OP_LOOP == op || OP_FOR_LOOP == op || OP_FOR_LOOP_CONSTANT == op ) return jump <= end ? end - jump : SIZE_MAX;
+    return end + jump;
+}
+
+bool liftChunk( Chunk* chunk, IRFunction* ir ) {
+    ir->chunk = chunk;
+    ir->arity = 0;
+    ir->blocks = NULL;
+    ir->blockCount = 0;
+    ir->bytes = NULL;
+    ir->byteCount = ir->byteCapacity = 0;
+    if( 0 == chunk->count ) return false;
+
+    // find where blocks start: at the entry, at every jump target & right after every jump or return
+    int* blockAt = (int*)malloc( sizeof( int ) * (chunk->count + 1) ); // block index starting at each offset (or -1)
+    bool* isStart = (bool*)calloc( chunk->count + 1, sizeof( bool ) ); // offsets where an instruction starts
+    if( NULL == blockAt || NULL == isStart ) exit( 1 );
+    for( size_t i = 0; i <= chunk->count; i++ ) blockAt[i] = -1;
+    bool ok = true;
+    blockAt[0] = 0;
+    for( size_t offset = 0, length; offset < chunk->count && ok; offset += length ) {
+        length = instructionLength( chunk, offset );
+        ok = 0 != length && offset + length <= chunk->count;
+        if( !ok ) break;
+        isStart[offset] = true;
+        uint8_t op = chunk->code[offset + (OP_WIDE == chunk->code[offset] ? 1 : 0)];
+        if( isJump( op ) ) {
+            size_t target = jumpTarget( chunk, offset );
+            ok = target < chunk->count;
+            if( ok ) blockAt[target] = 0;
+        }
+        if( isJump( op ) || OP_RETURN == op ) blockAt[offset + length] = 0;
+    }
+    for( size_t offset = 0; offset < chunk->count && ok; offset++ ) ok = -1 == blockAt[offset] || isStart[offset];
+
+    // number the blocks
+    for( size_t offset = 0; offset < chunk->count && ok; offset++ ) {
+        if( -1 != blockAt[offset] ) blockAt[offset] = ir->blockCount++;
+    }
+    blockAt[chunk->count] = -1;
+    if( ok ) {
+        ir->blocks = (IRBlock*)calloc( ir->blockCount, sizeof( IRBlock ) );
+        if( NULL == ir->blocks ) exit( 1 );
+    }
+
+    // fill them in (the jump that ends a block becomes its exit)
+    IRBlock* block = NULL;
+    size_t range = 0; // next inline range
+    for( size_t offset = 0, length; offset < chunk->count && ok; offset += length ) {
+        length = instructionLength( chunk, offset );
+        if( -1 != blockAt[offset] ) {
+            block = &ir->blocks[blockAt[offset]];
+            block->isLive = true;
+            block->exit = EXIT_FALLTHROUGH;
+        }
+        bool wide = OP_WIDE == chunk->code[offset];
+        uint8_t op = chunk->code[offset + (wide ? 1 : 0)];
+        int line = getLine( chunk, offset );
+        if( isJump( op ) ) {
+            size_t operands = offset + (wide ? 6 : 3); // (anything after the jump offset)
+            block->exit = OP_JUMP_IF_FALSE == op || isGuard( op ) || isCounted( op ) ? EXIT_BRANCH : EXIT_JUMP;
+            block->target = blockAt[jumpTarget( chunk, offset )];
+            block->branch = irInstruction( ir, op, false, chunk->code + operands, (int)(offset + length - operands), line );
+            continue;
+        }
+        size_t operands = offset + (wide ? 2 : 1);
+        IRInstruction instruction = irInstruction( ir, op, wide, chunk->code + operands, (int)(offset + length - operands), line );
+        while( range < chunk->inlineCount && chunk->inlines[range].end <= offset ) range++;
+        if( range < chunk->inlineCount && chunk->inlines[range].start <= offset ) instruction.inlined = (int)range;
+        appendInstruction( block, instruction );
+        if( OP_RETURN == op ) block->exit = EXIT_RETURN;
+    }
+
+    free( blockAt );
+    free( isStart );
+    if( !ok ) freeIR( ir );
+    return ok;
+}
+
+// -- LOWERING --
+
+// a jump is left out when it just goes to the next block
+static bool needsJump( IRFunction* ir, int b ) {
+    IRBlock* block = &ir->blocks[b];
+    if( EXIT_BRANCH == block->exit ) return true;
+    return EXIT_JUMP == block->exit && block->target != nextLiveBlock( ir, b );
+}
+
+static size_t blockLength( IRFunction* ir, int b ) {
+    IRBlock* block = &ir->blocks[b];
+    size_t length = 0;
+    for( int i = 0; i < block->count; i++ ) length += (block->code[i].wide ? 2 : 1) + block->code[i].length;
+    if( needsJump( ir, b ) ) length += (block->isWide ? 6 : 3) + (EXIT_BRANCH == block->exit ? block->branch.length : 0);
+    return length;
+}
+
+// distance a block's jump covers (from the end of its offset, forward or back)
+static size_t jumpDistance( IRFunction* ir, int b ) {
+    IRBlock* block = &ir->blocks[b];
+    size_t end = block->offset + blockLength( ir, b ) - (EXIT_BRANCH == block->exit ? block->branch.length : 0);
+    size_t to = ir->blocks[block->target].offset;
+    return to < end ? end - to : to - end;
+}
+
+void lowerIR( IRFunction* ir ) {
+    // jump relaxation: start w/ every jump short, then widen the ones that don't reach & lay out again. widening only
+    //  makes code longer, so this settles (usually after a single pass)
+    for( int b = 0; b < ir->blockCount; b++ ) ir->blocks[b].isWide = false;
+    for( bool changed = true; changed; ) {
+        changed = false;
+        size_t offset = 0;
+        for( int b = 0; b < ir->blockCount; b++ ) {
+            if( !ir->blocks[b].isLive ) continue;
+            ir->blocks[b].offset = offset;
+            offset += blockLength( ir, b );
+        }
+        for( int b = 0; b < ir->blockCount; b++ ) {
+            IRBlock* block = &ir->blocks[b];
+            if( !block->isLive || block->isWide || !needsJump( ir, b ) ) continue;
+            if( jumpDistance( ir, b ) > UINT16_MAX ) {
+                block->isWide = true;
+                changed = true;
+            }
+        }
+    }
+
+    // write the code back into the chunk (& the inline ranges, from a copy of the old ones)
+    Chunk* chunk = ir->chunk;
+    size_t rangeCount = chunk->inlineCount;
+    InlineRange* ranges = (InlineRange*)malloc( sizeof( InlineRange ) * (rangeCount + 1) );
+    if( NULL == ranges ) exit( 1 );
+    memcpy( ranges, chunk->inlines, sizeof( InlineRange ) * rangeCount );
+    chunk->count = 0;
+    chunk->lineCount = 0;
+    chunk->inlineCount = 0;
+    int lastInlined = -1;
+    for( int b = 0; b < ir->blockCount; b++ ) {
+        IRBlock* block = &ir->blocks[b];
+        if( !block->isLive ) continue;
+        for( int i = 0; i < block->count; i++ ) {
+            IRInstruction* instruction = &block->code[i];
+            if( -1 != instruction->inlined ) {
+                InlineRange* last = 0 == chunk->inlineCount ? NULL : &chunk->inlines[chunk->inlineCount - 1];
+                if( NULL == last || lastInlined != instruction->inlined || last->end != chunk->count ) {
+                    InlineRange range = ranges[instruction->inlined];
+                    range.start = range.end = chunk->count;
+                    addInline( chunk, range );
+                    last = &chunk->inlines[chunk->inlineCount - 1];
+                }
+                last->end = chunk->count + (instruction->wide ? 2 : 1) + instruction->length;
+                lastInlined = instruction->inlined;
+            }
+            if( instruction->wide ) writeChunk( chunk, OP_WIDE, instruction->line );
+            writeChunk( chunk, instruction->op, instruction->line );
+            uint8_t* operands = irOperands( ir, instruction );
+            for( int j = 0; j < instruction->length; j++ ) writeChunk( chunk, operands[j], instruction->line );
+        }
+        if( !needsJump( ir, b ) ) continue;
+
+        // the jump's direction comes from where its target ended up
+        size_t end = block->offset + blockLength( ir, b ), to = ir->blocks[block->target].offset;
+        size_t distance = jumpDistance( ir, b );
+        uint8_t op = EXIT_BRANCH == block->exit ? block->branch.op : to < end ? OP_LOOP : OP_JUMP;
+        int width = block->isWide ? 4 : 2, line = block->branch.line;
+        if( block->isWide ) writeChunk( chunk, OP_WIDE, line );
+        writeChunk( chunk, op, line );
+        for( int j = width - 1; j >= 0; j-- ) writeChunk( chunk, (uint8_t)(distance >> (8 * j)), line );
+        if( EXIT_BRANCH != block->exit ) continue;
+        uint8_t* operands = irOperands( ir, &block->branch );
+        for( int j = 0; j < block->branch.length; j++ ) writeChunk( chunk, operands[j], line );
+    }
+    free( ranges );
+}
+
+void freeIR( IRFunction* ir ) {
+    for( int b = 0; b < ir->blockCount; b++ ) free( ir->blocks[b].code );
+    free( ir->blocks );
+    free( ir->bytes );
+    ir->blocks = NULL;
+    ir->bytes = NULL;
+    ir->blockCount = 0;
+    ir->byteCount = ir->byteCapacity = 0;
+}
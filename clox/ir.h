@@ -0,0 +1,61 @@
+#pragma once
+#include "chunk.h"
+
+// a function's bytecode as a control flow graph, for the optimizer's post-emission passes (see optimizer.h)
+// this isn't a front end IR: the parser emits bytecode as it goes, & the CFG is only lifted from the finished chunk.
+//  liftChunk splits that into basic blocks, w/ the jumps taken out of the instruction stream & turned into edges, so
+//  passes can add, remove & rewrite instructions without fixing up any offsets. lowerIR lays the blocks back out in
+//  order & picks the width of every jump (see relaxation in ir.c)
+// blocks still hold stack machine instructions: there are no SSA values, so passes work on patterns of instructions, or
+//  follow the stack's contents through the edges (see inferNumbers in optimizer.c)
+
+// an instruction (w/o its OP_WIDE prefix, if it has one). its operand bytes live in the function's operand pool
+typedef struct {
+    uint8_t op;
+    bool wide;
+    int line;
+    size_t operands; // offset into IRFunction.bytes
+    int length; // # of operand bytes
+    int inlined; // the chunk's inline range it came from (or -1), so lowering can rebuild the ranges
+} IRInstruction;
+
+// how control leaves a block
+typedef enum {
+    EXIT_FALLTHROUGH, // into the next live block
+    EXIT_JUMP, // to 'target' (OP_JUMP or OP_LOOP, depending on where the target ends up)
+    EXIT_BRANCH, // OP_JUMP_IF_FALSE, a guard (OP_GUARD_CALL/INVOKE) or a counted loop's OP_FOR_PREP: maybe to 'target'
+                 //  (which must come later), else fall through. OP_FOR_LOOP is the one branch that goes back (both
+                 //  also have a _CONSTANT form)
+    EXIT_RETURN, // the block ends w/ OP_RETURN
+} IRExit;
+
+typedef struct {
+    IRInstruction* code;
+    int count, capacity;
+    IRExit exit;
+    int target; // block jumped to (EXIT_JUMP & EXIT_BRANCH only)
+    IRInstruction branch; // EXIT_BRANCH's instruction, w/ the operands that follow its jump offset (& the jump's line)
+    bool isLive; // false once the block is removed
+    bool isWide; // lowering: the jump needs a 32-bit offset
+    size_t offset; // lowering: where the block starts in the new code
+} IRBlock;
+
+typedef struct {
+    Chunk* chunk;
+    int arity; // # of parameters (the code starts w/ the callee & them on the stack)
+    IRBlock* blocks;
+    int blockCount;
+    uint8_t* bytes; // operand pool (instructions never share operand bytes, so they can be rewritten in place)
+    size_t byteCount, byteCapacity;
+} IRFunction;
+
+bool liftChunk( Chunk* chunk, IRFunction* ir ); // false if the code can't be decoded (ir is left empty)
+void lowerIR( IRFunction* ir ); // replaces the chunk's code (& lines) w/ the IR's
+void freeIR( IRFunction* ir );
+
+// helpers for passes
+uint8_t* irOperands( IRFunction* ir, IRInstruction* instruction );
+IRInstruction irInstruction( IRFunction* ir, uint8_t op, bool wide, const uint8_t* operands, int length, int line ); // copies the operands into the pool
+int irOperand( IRFunction* ir, IRInstruction* instruction ); // 1st operand (constant/slot, 1 or 2 bytes)
+int nextLiveBlock( IRFunction* ir, int block ); // -1 if none
+int insertBlock( IRFunction* ir, int at ); // adds an empty block before block 'at' (so pointers to blocks go stale)
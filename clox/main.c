@@ -5,6 +5,7 @@
 #include "debug.h"
 #include "scanner.h"
 #include "compiler.h"
+#include "optimizer.h"
 
 static char* readFile( const char* path ) {
     // open file
@@ -57,6 +58,14 @@ static int runFile( const char* path ) {
     return IS_ERROR( value ) ? 65 : 0; // return INTERPRET_COMPILE_ERROR == result ? 65 : INTERPRET_RUNTIME_ERROR == result ? 70 : 0;
 }
 
+// true if the instruction at offset pushes the number n (small ints are immediates, when the values can hold them)
+static bool pushesNumber( Chunk* chunk, size_t offset, double n ) {
+    if( offset + 1 >= chunk->count ) return false;
+    if( OP_SMALLINT == chunk->code[offset] ) return n == (double)(int8_t)chunk->code[offset + 1];
+    if( OP_CONSTANT == chunk->code[offset] ) return valuesEqual( chunk->constants.values[chunk->code[offset + 1]], NUMBER_VAL( n ) );
+    return false;
+}
+
 bool interpret_test( char* title, char* source, Value expected ) {
     // run test
     printf( "\n=> %s\n", title );
@@ -183,7 +192,7 @@ int main( int argc, const char* argv[] ) {
                 Value value = interpret_chunk( chunk ); // <-- note that VM takes ownership of chunk here
 
                 // validate
-                if( IS_STRING( value ) && valuesEqual( value, OBJ_VAL( makeString( "hihi", 4 ) ) ) ) {
+                if( isStringValue( value ) && valuesEqual( value, OBJ_VAL( makeString( "hihi", 4 ) ) ) ) {
                     printf( "SUCCESS (note: string interned OK, but constant is still duped!)\n" );
                 } else {
                     printf( "ERROR: Expected 'hihi', but got: " );
@@ -193,20 +202,85 @@ int main( int argc, const char* argv[] ) {
                     return 1;
                 }
 
+                // the compiler dedupes constants though (but only identical ones: a short literal "x" is packed into the value, so
+                //  it & the identifier x stay apart, even though they're equal)
+                ObjFunction* function = compile( "return x + \"hi, this one's heap allocated\" + \"x\" + \"hi, this one's heap allocated\" + 1.5 + 1.5 + 3000000000 + 3000000000.0;" );
+                size_t expected = FITS_SSO( 1 ) ? 5 : 4; // (w/o SSO, the literal "x" is the same interned string as x)
+                if( NULL != function && expected == function->chunk.constants.count ) {
+                    printf( "SUCCESS (note: compiled constants are deduped)\n" );
+                } else {
+                    printf( "ERROR: Expected %d constants, but got: %d\n", (int)expected, NULL == function ? -1 : (int)function->chunk.constants.count );
+                    if( NULL != function ) disassembleChunk( &function->chunk );
+                    freeVM();
+                    return 1;
+                }
+
                 // free VM
                 freeVM();
             }
 
+            // TEST
+            {
+                printf( "\n=> TEST LINE TABLE\n" );
+                initVM();
+
+                // lines 1, 1, 2, 7 & 7 make 3 runs. un-writing the last 2 bytes (like the compiler's peephole does)
+                //  must drop line 7's run, so the next byte starts a new one
+                Chunk chunk;
+                initChunk( &chunk );
+                int lines[] = { 1, 1, 2, 7, 7 };
+                for( int i = 0; i < 5; i++ ) writeChunk( &chunk, OP_NIL, lines[i] );
+                bool ok = 8 == sizeof( LineRun ) && 3 == chunk.lineCount && 1 == getLine( &chunk, 1 ) && 2 == getLine( &chunk, 2 ) && 7 == getLine( &chunk, 4 );
+                chunk.count -= 2;
+                writeChunk( &chunk, OP_NIL, 9 );
+                ok = ok && 3 == chunk.lineCount && 2 == getLine( &chunk, 2 ) && 9 == getLine( &chunk, 3 );
+                freeChunk( &chunk );
+                freeVM();
+
+                if( ok ) {
+                    printf( "SUCCESS\n" );
+                } else {
+                    printf( "ERROR: run-length encoded lines don't match what was written\n" );
+                    return 1;
+                }
+            }
+
+            // TEST
+            {
+                printf( "\n=> TEST JUMP RELAXATION\n" );
+                initVM();
+
+                // a wide jump (like the compiler's long-jump mode emits) over 1 byte has to come back short, w/ its line
+                Chunk chunk;
+                initChunk( &chunk );
+                uint8_t code[] = { OP_TRUE, OP_WIDE, OP_JUMP_IF_FALSE, 0, 0, 0, 1, OP_POP, OP_RETURN };
+                for( size_t i = 0; i < sizeof( code ); i++ ) writeChunk( &chunk, code[i], 1 == i ? 2 : 1 );
+                optimizeChunk( &chunk, 0 );
+                uint8_t expected[] = { OP_TRUE, OP_JUMP_IF_FALSE, 0, 1, OP_POP, OP_RETURN };
+                bool ok = sizeof( expected ) == chunk.count && 0 == memcmp( chunk.code, expected, chunk.count ) &&
+                          2 == getLine( &chunk, 1 ) && 1 == getLine( &chunk, 4 );
+                freeChunk( &chunk );
+                freeVM();
+
+                if( ok ) {
+                    printf( "SUCCESS\n" );
+                } else {
+                    printf( "ERROR: optimizer didn't shrink a wide jump\n" );
+                    return 1;
+                }
+            }
+
             // TEST
             {
                 printf( "\n=> TEST STRING INTERNING\n" );
                 initVM();
 
                 // create string objects "hello world" and "hi"
+                // (keep them on the stack, so a GC can't collect them before we count them)
                 size_t init_load = vm.strings.load;
-                concatStrings( "hello", 5, " world", 6 );
-                concatStrings( "hello", 5, " world", 6 );
-                makeString( "hi", 2 );
+                push( OBJ_VAL( concatStrings( "hello", 5, " world", 6 ) ) );
+                push( OBJ_VAL( concatStrings( "hello", 5, " world", 6 ) ) );
+                push( OBJ_VAL( makeString( "hi", 2 ) ) );
 
                 // test # of strings we actually created in the VM - it should just be two
                 if( 2 == vm.strings.load - init_load ) {
@@ -470,6 +544,448 @@ int main( int argc, const char* argv[] ) {
                 "return sec.num1();\n",
                 NUMBER_VAL( 3 ) ) ) { freeVM(); return 1; }
 
+            // test a table growing past linear mode into a hashed table (and reading back every field)
+            if( !interpret_test(
+                "MANY FIELDS",
+                "class Bag {}\n"
+                "var b = Bag();\n"
+                "b.f1 = 1; b.f2 = 2; b.f3 = 3; b.f4 = 4; b.f5 = 5; b.f6 = 6;\n"
+                "b.f7 = 7; b.f8 = 8; b.f9 = 9; b.f10 = 10; b.f11 = 11; b.f1 = 12;\n"
+                "return b.f1 + b.f2 + b.f3 + b.f4 + b.f5 + b.f6 + b.f7 + b.f8 + b.f9 + b.f10 + b.f11;\n",
+                NUMBER_VAL( 77 ) ) ) { freeVM(); return 1; }
+
+            // test maps w/ number, string, bool & object keys
+            if( !interpret_test(
+                "MAP",
+                "class Key {}\n"
+                "var k = Key();\n"
+                "var m = Map();\n"
+                "for( var i = 0; i < 100; i = i + 1 ) mapSet( m, i, i * 2 );\n"
+                "mapSet( m, \"a\", 1 ); mapSet( m, \"a\", 2 ); mapSet( m, true, 3 ); mapSet( m, k, 4 );\n"
+                "mapDelete( m, 7 ); mapDelete( m, 8 );\n"
+                "if( mapHas( m, 7 ) or mapGet( m, 8 ) != nil or mapGet( m, -0 ) != 0 ) return false;\n"
+                "var sum = 0;\n"
+                "for( var key = mapNext( m, nil ); key != nil; key = mapNext( m, key ) ) sum = sum + mapGet( m, key );\n"
+                "return sum + mapSize( m ) + mapGet( m, \"a\" ) + mapGet( m, k );\n",
+                NUMBER_VAL( 9986 ) ) ) { freeVM(); return 1; }
+
+            // test deleting the current key while iterating: its tombstone keeps its place, so every key is still visited
+            if( !interpret_test(
+                "MAP DELETE WHILE ITERATING",
+                "var m = Map();\n"
+                "for( var i = 0; i < 100; i = i + 2 ) { mapSet( m, i, false ); mapSet( m, i + 1, true ); }\n"
+                "var visited = 0;\n"
+                "for( var key = mapNext( m, nil ); key != nil; key = mapNext( m, key ) ) {\n"
+                "    visited = visited + 1;\n"
+                "    if( mapGet( m, key ) ) mapDelete( m, key );\n"
+                "}\n"
+                "mapSet( m, 1, 1 );\n" // (re-adding a deleted key reuses a tombstone)
+                "return visited * 1000 + mapSize( m ) + mapGet( m, 1 );\n",
+                NUMBER_VAL( 100 * 1000 + 51 + 1 ) ) ) { freeVM(); return 1; }
+            if( !interpret_test(
+                "MAP NEXT UNKNOWN KEY",
+                "var m = Map(); mapSet( m, 1, 1 ); mapNext( m, 2 );",
+                ERROR_VAL( RUNTIME_ERROR ) ) ) { freeVM(); return 1; }
+
+            // test that natives can report runtime errors
+            if( !interpret_test(
+                "MAP NIL KEY",
+                "var m = Map(); mapSet( m, nil, 1 );",
+                ERROR_VAL( RUNTIME_ERROR ) ) ) { freeVM(); return 1; }
+
+            // test arrays: literals, indexing, push & pop
+            if( !interpret_test(
+                "ARRAY",
+                "var a = [1, 2, 3];\n"
+                "for( var i = 0; i < 10; i = i + 1 ) push( a, i );\n"
+                "a[0] = a[1] + a[2];\n"
+                "var last = pop( a );\n"
+                "var sum = 0;\n"
+                "for( var i = 0; i < len( a ); i = i + 1 ) sum = sum + a[i];\n"
+                "var nested = [[1, 2], [3, [4]]];\n"
+                "return sum + last + nested[1][1][0] + len( [] );\n",
+                NUMBER_VAL( 5 + 2 + 3 + 36 + 9 + 4 ) ) ) { freeVM(); return 1; }
+
+            // test out-of-bounds array access
+            if( !interpret_test(
+                "ARRAY INDEX OUT OF BOUNDS",
+                "var a = [1, 2, 3]; return a[3];",
+                ERROR_VAL( RUNTIME_ERROR ) ) ) { freeVM(); return 1; }
+
+            // test indexing a map
+            if( !interpret_test(
+                "MAP INDEXING",
+                "var m = Map(); m[\"x\"] = 5; m[1] = m[\"x\"] * 2; return m[1] + len( m );",
+                NUMBER_VAL( 12 ) ) ) { freeVM(); return 1; }
+            if( !interpret_test(
+                "MAP NAN INDEX",
+                "var m = Map(); m[0/0] = 1;", // rejected like mapSet( m, 0/0, 1 )
+                ERROR_VAL( RUNTIME_ERROR ) ) ) { freeVM(); return 1; }
+
+            // test Float64Arrays & their vectorized natives (sizes chosen to exercise the scalar tails)
+            if( !interpret_test(
+                "FLOAT64ARRAY",
+                "var n = 19;\n"
+                "var x = Float64Array( n );\n"
+                "var y = Float64Array( n );\n"
+                "for( var i = 0; i < n; i = i + 1 ) { x[i] = i; y[i] = 1; }\n"
+                "f64Axpy( 2, x, y );\n"                      // y = 2i + 1
+                "f64Scale( 0.5, x );\n"                      // x = i / 2
+                "var z = f64Add( Float64Array( n ), x, y );\n" // z = 2.5i + 1
+                "f64Mul( z, z, Float64Array( [1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2] ) );\n"
+                "if( f64Min( x ) != 0 or f64Max( y ) != 37 or f64Min( Float64Array( 0 ) ) != nil ) return false;\n"
+                "return f64Sum( z ) + f64Dot( x, y ) + len( z );\n",
+                NUMBER_VAL( 492.5 + 2194.5 + 19 ) ) ) { freeVM(); return 1; }
+
+            // test ropes: appending in a loop, comparing ropes split differently, & using ropes as map keys
+            if( !interpret_test(
+                "ROPES",
+                "var s = \"\";\n"
+                "for( var i = 0; i < 200; i = i + 1 ) s = s + \"ab\";\n"
+                "var half = \"\";\n"
+                "for( var i = 0; i < 50; i = i + 1 ) half = \"abab\" + half;\n"
+                "var t = half + half;\n"
+                "if( s != t or s == t + \"a\" ) return false;\n"
+                "var m = Map(); m[s] = 7; m[half] = 1;\n"
+                "var u = \"\";\n"
+                "for( var i = 0; i < 50; i = i + 1 ) u = u + \"abab\";\n"
+                "return m[t] + m[u] + len( s );\n",
+                NUMBER_VAL( 7 + 1 + 400 ) ) ) { freeVM(); return 1; }
+
+            // test runtime strings: concatenation results aren't interned, but must still compare & hash by content
+            if( !interpret_test(
+                "LAZY INTERNING",
+                "var a = \"ab\" + \"c\"; var b = \"a\" + \"bc\";\n"
+                "if( a != b or a == \"abd\" or a != \"abc\" ) return false;\n"
+                "var m = Map(); m[a] = 3; m[\"abc\"] = m[b] + 1;\n"
+                "return m[a] + len( m );\n",
+                NUMBER_VAL( 4 + 1 ) ) ) { freeVM(); return 1; }
+
+            // test short strings: packed into values, but equal (& hashing the same) as their heap forms
+            if( !interpret_test(
+                "SHORT STRINGS",
+                "var s = \"\";\n"
+                "for( var i = 0; i < 3; i = i + 1 ) s = s + \"ab\";\n"                  // "ababab" overflows into a heap string
+                "var m = Map(); m[\"ab\" + \"c\"] = 1; m[s] = 2; m[\"a\"] = 3;\n"
+                "if( \"abc\" != \"ab\" + \"c\" or \"\" + \"\" != \"\" or len( \"abcde\" ) != 5 ) return false;\n"
+                "return m[\"abc\"] + m[\"ab\" + \"ab\" + \"ab\"] + m[\"a\"] + len( m );\n",
+                NUMBER_VAL( 1 + 2 + 3 + 3 ) ) ) { freeVM(); return 1; }
+            if( !interpret_test( "SHORT STRING VS HEAP STRING", "return \"ab\" + \"cd\";", OBJ_VAL( makeString( "abcd", 4 ) ) ) ) { freeVM(); return 1; }
+
+            // test the string library (the long line is sliced w/o copying, the short pieces are copied)
+            if( !interpret_test(
+                "STRING LIBRARY",
+                "var line = \"  alpha,beta,,gamma-delta-epsilon-zeta-eta-theta-iota  \";\n"
+                "var t = trim( line );\n"
+                "var parts = split( t, \",\" );\n"
+                "if( len( parts ) != 4 or parts[0] != \"alpha\" or parts[2] != \"\" ) return false;\n"
+                "if( parts[3] != \"gamma-delta-epsilon-zeta-eta-theta-iota\" or slice( t, 0, 5 ) != \"alpha\" ) return false;\n"
+                "var m = Map(); m[parts[3]] = 1;\n"
+                "return m[\"gamma-delta-epsilon-zeta-eta-theta-iota\"] + find( t, \"beta\" ) + find( t, \"kappa\" ) + charCode( t, 1 ) + len( t );\n",
+                NUMBER_VAL( 1 + 6 - 1 + 108 + 51 ) ) ) { freeVM(); return 1; }
+
+            // test calling plain functions (no upvalues, so no closure) alongside closures, as callbacks & methods
+            if( !interpret_test(
+                "FUNCTIONS & CLOSURES",
+                "fun twice( f, x ) { return f( f( x ) ); }\n"
+                "fun inc( x ) { return x + 1; }\n"
+                "fun adder( n ) { fun add( x ) { return x + n; } return add; }\n"
+                "class Counter { init() { this.n = 0; } bump() { this.n = this.n + 1; return this; } }\n"
+                "var c = Counter(); var bump = c.bump; bump(); c.bump().bump();\n"
+                "return twice( inc, 0 ) + twice( adder( 10 ), 0 ) + c.n;\n",
+                NUMBER_VAL( 2 + 20 + 3 ) ) ) { freeVM(); return 1; }
+
+            // test captures: never-assigned variables are copied into closures, assigned ones are shared through upvalues
+            if( !interpret_test(
+                "CAPTURE BY VALUE",
+                "fun outer() {\n"
+                "    var k = 3; var counter = 0;\n"
+                "    fun fib( n ) { if( n < 2 ) return n; return fib( n - 1 ) + fib( n - 2 ); }\n" // recursive local: by reference
+                "    fun scaled( x ) { counter = counter + 1; fun inner() { return x * k; } return inner(); }\n"
+                "    var total = 0;\n"
+                "    for( var i = 0; i < 4; i = i + 1 ) total = total + scaled( i );\n"
+                "    return total + fib( 10 ) + counter;\n"
+                "}\n"
+                "return outer();\n",
+                NUMBER_VAL( 18 + 55 + 4 ) ) ) { freeVM(); return 1; }
+
+            // test vtable dispatch: one call site sees several classes (overrides, inherited slots & a field shadowing a method)
+            if( !interpret_test(
+                "VTABLE DISPATCH",
+                "class A { f() { return 1; } g() { return 10; } }\n"
+                "class B < A { g() { return 20 + super.g(); } h() { return 100; } }\n"
+                "class C { g() { return 1000; } }\n"
+                "var c = C(); c.g = A().f;\n"
+                "var objs = [A(), B(), C(), B(), A(), c];\n"
+                "var sum = 0;\n"
+                "for( var i = 0; i < len( objs ); i = i + 1 ) sum = sum + objs[i].g();\n"
+                "return sum + B().f() + B().h();\n",
+                NUMBER_VAL( 10 + 30 + 1000 + 30 + 10 + 1 + 1 + 100 ) ) ) { freeVM(); return 1; }
+
+            // test presized instances: later instances get inline fields, & still grow past them when needed
+            if( !interpret_test(
+                "INSTANCE FIELD HINTS",
+                "class P { init( x ) { this.a = x; this.b = x; this.c = x; this.d = x; this.e = x; } }\n"
+                "class Q < P {}\n"
+                "var sum = 0;\n"
+                "for( var i = 0; i < 10; i = i + 1 ) {\n"
+                "    var p = P( i );\n"
+                "    if( i == 9 ) { p.f = 1; p.g = 1; p.h = 1; p.j = 1; p.k = 100; }\n" // outgrow the inline fields (into a hashed table)
+                "    sum = sum + p.a + p.e;\n"
+                "    if( i == 9 ) sum = sum + p.k;\n"
+                "}\n"
+                "var q = Q( 7 ); return sum + q.c;\n",
+                NUMBER_VAL( 90 + 100 + 7 ) ) ) { freeVM(); return 1; }
+
+            // the outlier above came after P's sampled instances, so it didn't raise the hint. Q samples its own instances
+            {
+                printf( "\n=> TEST FIELD HINT SAMPLING\n" );
+                Value p = interpret( "return P( 1 );\n", NIL_VAL );
+                bool ok = IS_INSTANCE( p ) && tableCapacityFor( 5 ) == AS_INSTANCE( p )->inlineCapacity;
+                Value q = interpret( "return Q( 1 );\n", NIL_VAL );
+                ok = ok && IS_INSTANCE( q ) && tableCapacityFor( 5 ) == AS_INSTANCE( q )->inlineCapacity;
+                if( ok ) {
+                    printf( "SUCCESS\n" );
+                } else {
+                    printf( "ERROR: expected room for 5 inline fields\n" );
+                    freeVM();
+                    return 1;
+                }
+            }
+
+            // test bound methods: calling a parenthesized property invokes it directly, & each read binds a new one
+            if( !interpret_test(
+                "BOUND METHODS",
+                "class A { init( n ) { this.n = n; } get() { return this.n; } }\n"
+                "class B < A { get() { var f = super.get; return f() * 10; } }\n"
+                "var a = A( 1 ); var b = B( 2 );\n"
+                "var fa = a.get;\n"
+                "var x = (a.get)() + (b.get)() + fa() + (nil and a.get or b.get)();\n"
+                "if( a.get() != fa() or a.get == fa or a.get == a.get ) return false;\n"
+                "return x;\n",
+                NUMBER_VAL( 1 + 20 + 1 + 20 ) ) ) { freeVM(); return 1; }
+
+            // test small ints: exact int math that overflows into doubles, mixed with doubles as the same numbers
+            if( !interpret_test(
+                "SMALL INTS",
+                "var big = 2147483647;\n"
+                "if( big + 1 != 2147483648 or -big - 2 != -2147483649 or 65536 * 65536 != 4294967296 ) return false;\n"
+                "if( 7 / 2 != 3.5 or 0.5 + 0.5 != 1 or 1 / (0 * -1) > 0 ) return false;\n"
+                "var m = Map(); mapSet( m, 3, true );\n"
+                "if( !mapGet( m, 1.5 * 2 ) ) return false;\n"
+                "var sum = 0;\n"
+                "for( var i = 0; i < 1000; i = i + 1 ) sum = sum + i * 3 - 1;\n"
+                "return sum;\n",
+                NUMBER_VAL( 3 * 499500 - 1000 ) ) ) { freeVM(); return 1; }
+
+            // test tagged object values: the same object must box to the same bits wherever it comes from
+            if( !interpret_test(
+                "OBJECT TAGS",
+                "class P { init() { fun g() { return this; } this.f = g; } }\n"
+                "var p = P(); var f = p.f; var s = \"a long string, longer than a short one\";\n"
+                "var m = Map(); mapSet( m, p, 1 ); mapSet( m, f, 2 ); mapSet( m, s, 3 ); mapSet( m, P, 4 );\n"
+                "if( p.f() != p or p.f != f or s + \"\" != s ) return false;\n"
+                "return mapGet( m, p ) + mapGet( m, p.f ) + mapGet( m, s ) + mapGet( m, P );\n",
+                NUMBER_VAL( 10 ) ) ) { freeVM(); return 1; }
+
+            // test constant interning: each name & literal takes up one constant slot per chunk, however often it's used
+            {
+                char source[16384] = "class C { init() { this.x = 0; } f() {\n";
+                for( int i = 0; i < 300; i++ ) strcat( source, "this.x = this.x + 1000 + 0.5;\n" );
+                strcat( source, "return this.x; } }\nreturn C().f() + 100 + -3;\n" );
+                if( !interpret_test( "CONSTANT INTERNING", source, NUMBER_VAL( 300 * 1000.5 + 100 - 3 ) ) ) { freeVM(); return 1; }
+            }
+            if( !interpret_test(
+                "CONSTANT INTERNING: literal & identifier w/ the same chars",
+                "var s = \"abc\"; var abc = \"def\"; return s + abc;\n",
+                OBJ_VAL( makeString( "abcdef", 6 ) ) ) ) { freeVM(); return 1; }
+
+            // test wide operands: > 256 constants, locals, upvalues & captures in one function (see OP_WIDE)
+            {
+                char* source = (char*)malloc( 65536 );
+                size_t n = 0;
+                for( int i = 0; i < 300; i++ ) n += sprintf( source + n, "var g%d = %d.25;\n", i, i );
+                n += sprintf( source + n, "class C { init() { this.p299 = 2; } m() { return this.p299; } }\nfun f() {\n" );
+                for( int i = 0; i < 300; i++ ) n += sprintf( source + n, "var v%d = %d.5;\n", i, i );
+                n += sprintf( source + n, "var w = 0; fun g() { w = w + v299; return w + v280; }\n" );
+                n += sprintf( source + n, "var c = C(); c.p299 = 3;\n" );
+                n += sprintf( source + n, "g(); return g() + v0 + v299 + c.p299 + C().m(); }\nreturn f() + g0 + g299;\n" );
+                bool ok = interpret_test( "WIDE OPERANDS", source, NUMBER_VAL( 879.5 + 0.5 + 299.5 + 3 + 2 + 0.25 + 299.25 ) );
+                free( source );
+                if( !ok ) { freeVM(); return 1; }
+            }
+
+            // test stack overflow: a function w/ 400 locals fills the stack long before the max call depth
+            {
+                char* source = (char*)malloc( 65536 );
+                size_t n = sprintf( source, "fun f( n ) {\n" );
+                for( int i = 0; i < 400; i++ ) n += sprintf( source + n, "var v%d = n;\n", i );
+                n += sprintf( source + n, "if( n > 0 ) return f( n - 1 ) + v399; return 0; }\n" );
+                strcpy( source + n, "return f( 30 );\n" );
+                bool ok = interpret_test( "STACK OVERFLOW: many locals (fits)", source, NUMBER_VAL( 30 * 31 / 2 ) );
+                strcpy( source + n, "return f( 60 );\n" );
+                ok = ok && interpret_test( "STACK OVERFLOW: many locals", source, ERROR_VAL( RUNTIME_ERROR ) );
+                free( source );
+                if( !ok ) { freeVM(); return 1; }
+            }
+
+            // test long jumps: an if & a loop whose bodies are > 64 KB of bytecode (compiled again w/ 32-bit jumps)
+            {
+                char* source = (char*)malloc( 262144 );
+                size_t n = sprintf( source, "var x = 0; var i = 0;\nif( x == 0 ) {\n" );
+                for( int i = 0; i < 9000; i++ ) n += sprintf( source + n, "x = x + 1;\n" );
+                n += sprintf( source + n, "} else { x = -1; }\nwhile( i < 3 ) { i = i + 1;\n" );
+                for( int i = 0; i < 9000; i++ ) n += sprintf( source + n, "x = x + 1;\n" );
+                n += sprintf( source + n, "}\nreturn x;\n" );
+                bool ok = interpret_test( "LONG JUMPS", source, NUMBER_VAL( 4 * 9000 ) );
+                free( source );
+                if( !ok ) { freeVM(); return 1; }
+            }
+
+            // test the bytecode optimizer's output: constants get folded (keeping their line), the pops at the end of nested
+            //  blocks get coalesced, code after a return is dropped, & arithmetic on locals that only ever hold numbers
+            //  is unchecked (but not once a store around the loop's back edge can make them something else), & counted
+            //  for loops use OP_FOR_PREP & OP_FOR_LOOP
+            {
+                printf( "\n=> TEST BYTECODE OPTIMIZER OUTPUT\n" );
+                ObjFunction* folded = compile( "return 1 + 2;\n" );
+                bool ok = NULL != folded && 3 == folded->chunk.count && pushesNumber( &folded->chunk, 0, 3 ) &&
+                          OP_RETURN == folded->chunk.code[2];
+                ObjFunction* lines = compile( "var x = 1;\nreturn x +\n2 * 3;\n" );
+                ok = ok && NULL != lines && lines->chunk.count >= 4 && pushesNumber( &lines->chunk, lines->chunk.count - 4, 6 ) &&
+                     3 == getLine( &lines->chunk, lines->chunk.count - 4 );
+                ObjFunction* pops = compile( "{ var a = 1; { var b = 2; var c = 3; } }\n" );
+                uint8_t expectPops[] = { OP_SMALLINT, 1, OP_SMALLINT, 2, OP_SMALLINT, 3, OP_POPN, 3, OP_NIL, OP_RETURN };
+                ok = ok && NULL != pops && sizeof( expectPops ) == pops->chunk.count &&
+                     0 == memcmp( pops->chunk.code, expectPops, sizeof( expectPops ) );
+                ObjFunction* dead = compile( "return 1;\nprint 2;\n" );
+                uint8_t expectDead[] = { OP_SMALLINT, 1, OP_RETURN };
+                ok = ok && NULL != dead && sizeof( expectDead ) == dead->chunk.count &&
+                     0 == memcmp( dead->chunk.code, expectDead, sizeof( expectDead ) );
+                #ifdef NUMBER_TYPES
+                ObjFunction* types = compile( "{\n"
+                                              "    var s = 0;\n"
+                                              "    while( s < 10 ) s = s + 2;\n"
+                                              "    var t = 0;\n"
+                                              "    while( t < 10 ) { t = t + 1; if( t == 5 ) t = \"a\"; }\n"
+                                              "}\n" );
+                ok = ok && NULL != types && types->chunk.count > 38 && OP_LESS_NUM == types->chunk.code[6] &&
+                     OP_ADD_NUM == types->chunk.code[15] && OP_LESS == types->chunk.code[29] && OP_ADD == types->chunk.code[38];
+                #endif
+                #ifdef COUNTED_LOOPS
+                ObjFunction* counted = compile( "{ for( var i = 0; i < 3; i = i + 1 ) print i; }\n" );
+                uint8_t expectCounted[] = { OP_SMALLINT, 0, OP_FOR_PREP_CONSTANT, 0, 10, 1, 0, OP_GET_LOCAL, 1, OP_PRINT,
+                                            OP_FOR_LOOP_CONSTANT, 0, 6, 1, 0, OP_POP, OP_NIL, OP_RETURN };
+                ok = ok && NULL != counted && sizeof( expectCounted ) == counted->chunk.count &&
+                     0 == memcmp( counted->chunk.code, expectCounted, sizeof( expectCounted ) );
+                #endif
+
+                if( ok ) {
+                    printf( "SUCCESS\n" );
+                } else {
+                    printf( "ERROR: optimized bytecode doesn't match (is OPTIMIZE_BYTECODE on?)\n" );
+                    freeVM();
+                    return 1;
+                }
+            }
+
+            // test the bytecode optimizer: folded constants, threaded jumps, dead code & coalesced pops must not change results
+            if( !interpret_test(
+                "BYTECODE OPTIMIZER",
+                "fun f( a ) {\n"
+                "    var x = 1 + 2 * 3 - -4 / 2;\n"
+                "    if( \"ab\" + \"cd\" != \"abcd\" or 1 / (0 * -1) > 0 or 2147483647 + 1 != 2147483648 ) return false;\n"
+                "    if( a and !nil and a ) { var p = 1; { var q = 2; var r = 3; x = x + p + q + r; } }\n"
+                "    while( a and a < 0 ) { var t = 1; a = a + t; }\n"
+                "    return x + (a or 0);\n"
+                "    x = 100;\n"
+                "}\n"
+                "return f( -3 ) + f( false ) * 100;\n",
+                NUMBER_VAL( (9 + 6 + 0) + 9 * 100 ) ) ) { freeVM(); return 1; }
+
+            if( !interpret_test(
+                "INLINING",
+                "fun sq( x ) { return x * x; }\n"
+                "fun mad( a, b, c ) { return a * b + c; }\n"
+                "class P {\n"
+                "    init( x ) { this.x = x; }\n"
+                "    getX() { return this.x; }\n"
+                "    twice() { return this.getX() * 2; }\n"
+                "}\n"
+                "class Q < P { getX() { return 100; } }\n"
+                "fun useSq( n ) { return sq( n ); }\n"
+                "var r = sq( 3 ) + mad( 2, sq( 2 ), 1 ) + P( 5 ).twice() + Q( 5 ).twice();\n"
+                "fun sq( x ) { return -x; }\n" // useSq's guard sees the new binding & calls it instead
+                "return r * 1000 + useSq( 7 );\n",
+                NUMBER_VAL( (9 + 9 + 10 + 200) * 1000 - 7 ) ) ) { freeVM(); return 1; }
+
+            if( !interpret_test(
+                "LOOP INVARIANT LOADS",
+                "var n = 4;\n"
+                "var k = 10;\n"
+                "fun bump() { k = k + 1; }\n"
+                "class A {\n"
+                "    init() { this.v = 1; }\n"
+                "    double() { this.v = this.v * 2; }\n"
+                "    sum() { var r = 0; for( var i = 0; i < n; i = i + 1 ) { r = r + this.v; this.double(); } return r; }\n"
+                "}\n"
+                "var s = 0;\n"
+                "var i = 0;\n"
+                "while( i < n ) { s = s + k; bump(); i = i + 1; }\n" // bump changes k under the hoisted load
+                "return s * 100 + A().sum();\n",
+                NUMBER_VAL( (10 + 11 + 12 + 13) * 100 + 15 ) ) ) { freeVM(); return 1; }
+
+            if( !interpret_test(
+                "NUMBER TYPES",
+                "fun f( p ) {\n"
+                "    var x = 1;\n"
+                "    var y = 2;\n"
+                "    var s = \"\";\n"
+                "    fun g() { y = \"b\"; }\n"
+                "    for( var i = 0; i < 3; i = i + 1 ) {\n"
+                "        var xx = x + x;\n"
+                "        var yy = y + y;\n"
+                "        if( xx == 2 ) s = s + \"n\"; else s = s + xx;\n"
+                "        if( yy == 4 ) s = s + \"n\"; else s = s + yy;\n"
+                "        if( i == 0 ) x = \"a\";\n" // reaches 'x + x' on the next iteration (through the loop's back edge)
+                "        if( i == 1 ) g();\n" // y is assigned through an upvalue, so it's never known to be a number
+                "    }\n"
+                "    return s == \"nnaanaabb\" and -p * 2 == -3;\n" // p is a parameter, so its type is never known
+                "}\n"
+                "return f( 1.5 );\n",
+                BOOL_VAL( true ) ) ) { freeVM(); return 1; }
+
+            if( !interpret_test(
+                "NUMBER TYPES: nested loops",
+                "fun f() {\n"
+                "    var x = 1;\n"
+                "    var s = \"\";\n"
+                "    for( var i = 0; i < 2; i = i + 1 ) {\n"
+                "        var xx = x + x;\n"
+                "        if( xx == 2 ) s = s + \"n\"; else s = s + xx;\n"
+                "        var j = 0;\n"
+                "        while( j < 1 ) { x = \"a\"; j = j + 1; }\n" // reaches the outer loop's 'x + x' through 2 back edges
+                "    }\n"
+                "    return s;\n"
+                "}\n"
+                "return f();\n",
+                OBJ_VAL( makeString( "naa", 3 ) ) ) ) { freeVM(); return 1; }
+
+            if( !interpret_test(
+                "COUNTED LOOPS",
+                "fun f( a ) {\n"
+                "    var n = len( a );\n"
+                "    var s = 0;\n"
+                "    for( var i = 0; i < n; i = i + 1 ) s = s + a[i];\n" // local limit
+                "    for( var i = 0; i < 3; i = i + 1 ) { if( i == 0 ) i = 1; s = s + i * 100; }\n" // literal limit, body moves the counter
+                "    for( var i = 0.5; i < 2; i = i + 1 ) s = s + i * 1000;\n" // not a small int
+                "    for( var i = 9; i < n; i = i + 1 ) s = s + 10000;\n" // never runs
+                "    for( var i = 0; i < n; i = i + 2 ) s = s + 100000;\n" // not counted: compiled generically
+                "    return s;\n"
+                "}\n"
+                "return f( [ 1, 2, 3, 4 ] );\n",
+                NUMBER_VAL( 10 + 300 + 2000 + 200000 ) ) ) { freeVM(); return 1; }
+
             // benchmark field access
             if( !interpret_test(
                 "TABLE ACCESS PERFORMANCE",
@@ -506,6 +1022,98 @@ int main( int argc, const char* argv[] ) {
                 "print sum;\n",
                 NIL_VAL ) ) { freeVM(); return 1; }
 
+            // benchmark number crunching (see OP_ADD_NUM)
+            if( !interpret_test(
+                "MANDELBROT PERFORMANCE",
+                "fun mandelbrot( size, iterations ) {\n"
+                "    var inside = 0;\n"
+                "    for( var py = 0; py < size; py = py + 1 ) {\n"
+                "        var ci = py * 2.0 / size - 1.0;\n"
+                "        for( var px = 0; px < size; px = px + 1 ) {\n"
+                "            var cr = px * 2.0 / size - 1.5;\n"
+                "            var zr = 0.0;\n"
+                "            var zi = 0.0;\n"
+                "            var i = 0;\n"
+                "            while( i < iterations and zr * zr + zi * zi <= 4.0 ) {\n"
+                "                var t = zr * zr - zi * zi + cr;\n"
+                "                zi = 2.0 * zr * zi + ci;\n"
+                "                zr = t;\n"
+                "                i = i + 1;\n"
+                "            }\n"
+                "            if( i == iterations ) inside = inside + 1;\n"
+                "        }\n"
+                "    }\n"
+                "    return inside;\n"
+                "}\n"
+                "\n"
+                "var start = clock();\n"
+                "var inside = mandelbrot( 120, 100 );\n"
+                "print clock() - start;\n"
+                "print inside;\n",
+                NIL_VAL ) ) { freeVM(); return 1; }
+            if( !interpret_test(
+                "NBODY PERFORMANCE",
+                "class Body {\n"
+                "    init( x, y, z, vx, vy, vz, mass ) {\n"
+                "        this.x = x; this.y = y; this.z = z;\n"
+                "        this.vx = vx; this.vy = vy; this.vz = vz;\n"
+                "        this.mass = mass;\n"
+                "    }\n"
+                "}\n"
+                "\n"
+                "fun advance( bodies, count, dt ) {\n"
+                "    for( var i = 0; i < count; i = i + 1 ) {\n"
+                "        var a = bodies[i];\n"
+                "        for( var j = i + 1; j < count; j = j + 1 ) {\n"
+                "            var b = bodies[j];\n"
+                "            var dx = a.x - b.x;\n"
+                "            var dy = a.y - b.y;\n"
+                "            var dz = a.z - b.z;\n"
+                "            var d2 = dx * dx + dy * dy + dz * dz;\n"
+                "            var mag = dt / (d2 * sqrt( d2 ));\n"
+                "            var am = a.mass * mag;\n"
+                "            var bm = b.mass * mag;\n"
+                "            a.vx = a.vx - dx * bm; a.vy = a.vy - dy * bm; a.vz = a.vz - dz * bm;\n"
+                "            b.vx = b.vx + dx * am; b.vy = b.vy + dy * am; b.vz = b.vz + dz * am;\n"
+                "        }\n"
+                "    }\n"
+                "    for( var i = 0; i < count; i = i + 1 ) {\n"
+                "        var body = bodies[i];\n"
+                "        body.x = body.x + dt * body.vx; body.y = body.y + dt * body.vy; body.z = body.z + dt * body.vz;\n"
+                "    }\n"
+                "}\n"
+                "\n"
+                "fun energy( bodies, count ) {\n"
+                "    var e = 0.0;\n"
+                "    for( var i = 0; i < count; i = i + 1 ) {\n"
+                "        var a = bodies[i];\n"
+                "        e = e + 0.5 * a.mass * (a.vx * a.vx + a.vy * a.vy + a.vz * a.vz);\n"
+                "        for( var j = i + 1; j < count; j = j + 1 ) {\n"
+                "            var b = bodies[j];\n"
+                "            var dx = a.x - b.x;\n"
+                "            var dy = a.y - b.y;\n"
+                "            var dz = a.z - b.z;\n"
+                "            e = e - a.mass * b.mass / sqrt( dx * dx + dy * dy + dz * dz );\n"
+                "        }\n"
+                "    }\n"
+                "    return e;\n"
+                "}\n"
+                "\n"
+                "var bodies = [\n"
+                "    Body( 0, 0, 0, 0, 0, 0, 39.47841760435743 ),\n"
+                "    Body( 4.84, -1.16, -0.10, 0.606, 2.81, -0.02, 0.03769367487038949 ),\n"
+                "    Body( 8.34, 4.12, -0.40, -1.01, 1.82, 0.008, 0.011286326131968767 ),\n"
+                "    Body( 12.89, -15.11, -0.22, 1.08, 0.868, -0.01, 0.0017237240570597112 ),\n"
+                "    Body( 15.37, -25.91, 0.17, 0.979, 0.594, -0.034, 0.0020336868699246304 )\n"
+                "];\n"
+                "var start = clock();\n"
+                "var before = energy( bodies, 5 );\n"
+                "for( var step = 0; step < 20000; step = step + 1 ) advance( bodies, 5, 0.01 );\n"
+                "print clock() - start;\n"
+                "print before;\n"
+                "print energy( bodies, 5 );\n",
+                NIL_VAL ) ) { freeVM(); return 1; }
+
             // done
             freeVM();
             return 0;
@@ -0,0 +1,139 @@
+#include <string.h>
+#include "map.h"
+#include "memory.h"
+#include "object.h"
+
+// note: isnan() gets optimized away under -ffast-math, so check the bits directly
+static bool isNaN( double num ) {
+    uint64_t bits;
+    memcpy( &bits, &num, sizeof( double ) );
+    return (bits & 0x7ff0000000000000ull) == 0x7ff0000000000000ull && (bits & 0x000fffffffffffffull) != 0;
+}
+
+bool isMapKey( Value key ) { return !IS_NIL( key ) && !(IS_NUMBER( key ) && isNaN( AS_NUMBER( key ) )); }
+
+#define TOMBSTONE ERROR_VAL( RUNTIME_ERROR )
+static inline bool isLive( MapEntry* entry ) { return !IS_NIL( entry->key ) && !IS_ERROR( entry->value ); }
+
+// find entry via linear probing (returns the 1st tombstone or empty slot if the key isn't present)
+// if deleted is set, a tombstone that still holds the key counts as a match too (see mapNext)
+static MapEntry* findEntry( MapEntry* entries, size_t capacity, Value key, bool deleted ) {
+    // 1st tombstone found
+    MapEntry* t = NULL;
+
+    // linear probe
+    for( size_t i = hashValue( key ) & (capacity - 1);; i = (i + 1) & (capacity - 1) ) {
+        MapEntry* e = &entries[i];
+
+        // if empty: we know the key doesn't exist, so return first available slot
+        if( IS_NIL( e->key ) ) return NULL != t ? t : e;
+
+        // otherwise: save the tombstone, or check for a match
+        if( IS_ERROR( e->value ) ) {
+            if( deleted && valuesEqual( e->key, key ) ) return e;
+            if( NULL == t ) t = e;
+        } else if( valuesEqual( e->key, key ) ) return e;
+    }
+}
+
+static void adjustCapacity( ObjMap* map, size_t newCapacity ) {
+    // allocate new entries (cannot rely on NIL being zero w/ NaN boxing)
+    MapEntry* newEntries = allocate( sizeof( MapEntry ) * newCapacity );
+    for( size_t i = 0; i < newCapacity; i++ ) {
+        newEntries[i].key = NIL_VAL;
+        newEntries[i].value = NIL_VAL;
+    }
+
+    // insert existing entries into the new buffer (dropping tombstones)
+    for( size_t i = 0; i < map->capacity; i++ ) {
+        MapEntry* entry = &map->entries[i];
+        if( !isLive( entry ) ) continue;
+        *findEntry( newEntries, newCapacity, entry->key, false ) = *entry;
+    }
+
+    // swap buffers
+    freeArray( sizeof( MapEntry ), map->entries, map->capacity );
+    map->load = map->count;
+    map->capacity = newCapacity;
+    map->entries = newEntries;
+}
+
+bool mapGet( ObjMap* map, Value key, Value* value ) {
+    if( 0 == map->count ) return false;
+    key = flattenValue( key );
+    MapEntry* entry = findEntry( map->entries, map->capacity, key, false );
+    if( !isLive( entry ) ) return false;
+    *value = entry->value;
+    return true;
+}
+
+bool mapSet( ObjMap* map, Value key, Value value ) {
+    key = flattenValue( key ); // store ropes as their (interned) flat string, so they hash & compare like any other string
+    // grow the map if we exceed our max load
+    if( map->load + 1 > map->capacity * MAP_MAX_LOAD )
+        adjustCapacity( map, growCapacity( map->capacity ) );
+
+    // get entry for this key
+    MapEntry* entry = findEntry( map->entries, map->capacity, key, false );
+
+    // bump counts for new keys (load only if we didn't reuse a tombstone)
+    bool isNewKey = !isLive( entry );
+    if( isNewKey ) {
+        if( IS_NIL( entry->key ) ) map->load++;
+        map->count++;
+    }
+
+    // set the entry
+    entry->key = key;
+    entry->value = value;
+    return isNewKey;
+}
+
+bool mapDelete( ObjMap* map, Value key ) {
+    if( 0 == map->count ) return false;
+    key = flattenValue( key );
+    MapEntry* entry = findEntry( map->entries, map->capacity, key, false );
+    if( !isLive( entry ) ) return false;
+
+    // place a tombstone in the entry (the key stays, see mapNext)
+    entry->value = TOMBSTONE;
+    map->count--;
+    return true;
+}
+
+bool mapNext( ObjMap* map, Value* key ) {
+    // find where to resume from (a deleted key's tombstone still marks its place)
+    size_t i = 0;
+    if( !IS_NIL( *key ) ) {
+        if( 0 == map->capacity ) return false;
+        Value flat = flattenValue( *key );
+        MapEntry* entry = findEntry( map->entries, map->capacity, flat, true );
+        if( IS_NIL( entry->key ) || !valuesEqual( entry->key, flat ) ) return false; // key isn't in the map
+        i = (size_t)(entry - map->entries) + 1;
+    }
+
+    // scan forward to the next live entry
+    for( ; i < map->capacity; i++ ) {
+        if( isLive( &map->entries[i] ) ) {
+            *key = map->entries[i].key;
+            return true;
+        }
+    }
+    *key = NIL_VAL;
+    return true;
+}
+
+// (tombstones' keys too, since mapNext can still compare against them)
+void markMap( ObjMap* map ) {
+    for( size_t i = 0; i < map->capacity; i++ ) {
+        MapEntry* entry = &map->entries[i];
+        markValue( entry->key );
+        markValue( entry->value );
+    }
+}
+
+void freeMapEntries( ObjMap* map ) {
+    freeArray( sizeof( MapEntry ), map->entries, map->capacity );
+    map->count = map->load = map->capacity = 0;
+    map->entries = NULL;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "common.h"
+#include "value.h"
+
+#define MAP_MAX_LOAD 0.75
+
+typedef struct ObjMap ObjMap;
+
+typedef struct {
+    Value key;
+    Value value;
+} MapEntry;
+
+// value-keyed hashmap, backing the script-visible Map type
+// unlike Table (which only takes interned ObjString* keys), keys can be any non-nil value: they are hashed
+//  w/ hashValue() and compared w/ valuesEqual() (rope keys are flattened first, so keys must be reachable by the GC). an empty slot has a nil key & nil value
+// a tombstone keeps its key (w/ an error value, which scripts can never store), so iteration can still resume from a
+//  key deleted along the way (see mapNext)
+bool isMapKey( Value key ); // false for nil (it marks empty slots) & NaN (it never equals itself, so it could never be found)
+bool mapGet( ObjMap* map, Value key, Value* value );
+bool mapSet( ObjMap* map, Value key, Value value ); // returns true if the key is new
+bool mapDelete( ObjMap* map, Value key );
+// advances *key to the next key in the map (nil starts iteration, & is what *key becomes once every key was visited)
+// *key can be a key that was deleted since, but not one deleted before the map last grew: returns false if it's unknown
+bool mapNext( ObjMap* map, Value* key );
+void markMap( ObjMap* map );
+void freeMapEntries( ObjMap* map );
@@ -65,6 +65,7 @@ static void blackenObject( Obj* object ) {
             ObjClass* class = (ObjClass*)object;
             markObject( (Obj*)class->name );
             markTable( &class->methods );
+            for( int i = 0; i < class->methodCount; i++ ) markObject( class->vtable[i].method ); // names are marked by the table
             break;
         }
         case OBJ_INSTANCE: {
@@ -77,6 +78,7 @@ static void blackenObject( Obj* object ) {
             ObjClosure* closure = (ObjClosure*)object;
             markObject( (Obj*)closure->function );
             for( int i = 0; i < closure->upvalueCount; i++ ) markObject( (Obj*)closure->upvalues[i] );
+            for( int i = 0; i < closure->captureCount; i++ ) markValue( closure->captures[i] );
             break;
         }
         case OBJ_FUNCTION: {
@@ -88,7 +90,21 @@ static void blackenObject( Obj* object ) {
         case OBJ_UPVALUE:
             markValue( ((ObjUpvalue*)object)->closed );
             break;
-        case OBJ_NATIVE: case OBJ_STRING: break;
+        case OBJ_MAP:
+            markMap( (ObjMap*)object );
+            break;
+        case OBJ_ARRAY:
+            markArray( &((ObjArray*)object)->values );
+            break;
+        case OBJ_ROPE: {
+            ObjRope* rope = (ObjRope*)object;
+            markObject( rope->left );
+            markObject( rope->right );
+            markObject( (Obj*)rope->flat );
+            break;
+        }
+        case OBJ_SLICE: markObject( (Obj*)((ObjSlice*)object)->parent ); break;
+        case OBJ_NATIVE: case OBJ_STRING: case OBJ_F64ARRAY: break;
     }
 }
 
@@ -166,8 +182,7 @@ static void freeObject( Obj* o ) {
         case OBJ_NATIVE: deallocate( o, sizeof( ObjNative ) ); break;
         case OBJ_CLOSURE: {
             ObjClosure* c = (ObjClosure*)o;
-            freeArray( sizeof( ObjUpvalue* ), c->upvalues, c->upvalueCount );
-            deallocate( o, sizeof( ObjClosure ) );
+            deallocate( o, sizeof( ObjClosure ) + sizeof( ObjUpvalue* ) * c->upvalueCount + sizeof( Value ) * c->captureCount );
             break;
         }
         case OBJ_FUNCTION: {
@@ -179,19 +194,33 @@ static void freeObject( Obj* o ) {
         case OBJ_CLASS: {
             ObjClass* c = (ObjClass*)o;
             freeTable( &c->methods );
+            freeArray( sizeof( MethodSlot ), c->vtable, c->methodCapacity );
             deallocate( o, sizeof( ObjClass ) );
             break;
         }
         case OBJ_INSTANCE: {
             ObjInstance* instance = (ObjInstance*)o;
             freeTable( &instance->fields ); // note: no need to free individual entries, since GC will take care of those (there may be other references to them)
-            deallocate( o, sizeof( ObjInstance ) );
+            deallocate( o, sizeof( ObjInstance ) + sizeof( Entry ) * instance->inlineCapacity );
             break;
         }
         case OBJ_BOUND_METHOD: {
             deallocate( o, sizeof( ObjBoundMethod ) );
             break;
         }
+        case OBJ_MAP: {
+            freeMapEntries( (ObjMap*)o );
+            deallocate( o, sizeof( ObjMap ) );
+            break;
+        }
+        case OBJ_ARRAY: {
+            freeValueArray( &((ObjArray*)o)->values );
+            deallocate( o, sizeof( ObjArray ) );
+            break;
+        }
+        case OBJ_F64ARRAY: deallocate( o, sizeof( ObjF64Array ) + sizeof( double ) * ((ObjF64Array*)o)->count ); break;
+        case OBJ_ROPE: deallocate( o, sizeof( ObjRope ) ); break;
+        case OBJ_SLICE: deallocate( o, sizeof( ObjSlice ) ); break;
         default: break; // unreachable
     }
 }
@@ -218,8 +247,9 @@ static void markRoots() {
         markValue( *slot );
     }
 
-    // mark the closures inside of each CallFrame
+    // mark the functions & closures inside of each CallFrame
     for( int i = 0; i < vm.frameCount; i++ ) {
+        markObject( (Obj*)vm.frames[i].function );
         markObject( (Obj*)vm.frames[i].closure );
     }
 
@@ -281,7 +311,7 @@ void collectGarbage() {
     // mark phase of mark-end-sweep
     markRoots();
     traceReferences();
-    tableRemoveWhite( &vm.strings );
+    stringSetRemoveWhite( &vm.strings );
     sweep();
 
     // adjust memory threshold for next GC
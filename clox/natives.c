@@ -0,0 +1,355 @@
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "natives.h"
+#include "f64.h"
+#include "object.h"
+#include "vm.h"
+
+#define NATIVE_ERROR ERROR_VAL( RUNTIME_ERROR )
+
+// validates the # of arguments passed to a native
+static bool checkArity( const char* name, int argCount, int arity ) {
+    if( argCount == arity ) return true;
+    runtimeError( "%s() expected %d arguments but got %d.", name, arity, argCount );
+    return false;
+}
+
+// -- MISC --
+
+// a simple clock function
+Value clockNative( int argCount, Value* args ) {
+    return NUMBER_VAL( (double)clock() / CLOCKS_PER_SEC );
+}
+
+// -- MAPS --
+
+static bool checkMap( const char* name, Value value ) {
+    if( IS_MAP( value ) ) return true;
+    runtimeError( "%s() expects a map as its first argument.", name );
+    return false;
+}
+
+// (see isMapKey)
+static bool checkKey( const char* name, Value key ) {
+    if( isMapKey( key ) ) return true;
+    runtimeError( "%s() key cannot be nil or NaN.", name );
+    return false;
+}
+
+// Map() => a new, empty map
+Value mapNative( int argCount, Value* args ) {
+    if( !checkArity( "Map", argCount, 0 ) ) return NATIVE_ERROR;
+    return OBJ_VAL( newMap() );
+}
+
+// mapGet( map, key ) => the value for key, or nil if it isn't present
+Value mapGetNative( int argCount, Value* args ) {
+    if( !checkArity( "mapGet", argCount, 2 ) || !checkMap( "mapGet", args[0] ) ) return NATIVE_ERROR;
+    Value value;
+    return mapGet( AS_MAP( args[0] ), args[1], &value ) ? value : NIL_VAL;
+}
+
+// mapSet( map, key, value ) => value
+Value mapSetNative( int argCount, Value* args ) {
+    if( !checkArity( "mapSet", argCount, 3 ) || !checkMap( "mapSet", args[0] ) || !checkKey( "mapSet", args[1] ) ) return NATIVE_ERROR;
+    mapSet( AS_MAP( args[0] ), args[1], args[2] ); // note: args are still on the VM stack, so a GC here can see them
+    return args[2];
+}
+
+// mapHas( map, key ) => true if key is present
+Value mapHasNative( int argCount, Value* args ) {
+    if( !checkArity( "mapHas", argCount, 2 ) || !checkMap( "mapHas", args[0] ) ) return NATIVE_ERROR;
+    Value value;
+    return BOOL_VAL( mapGet( AS_MAP( args[0] ), args[1], &value ) );
+}
+
+// mapDelete( map, key ) => true if key was present
+Value mapDeleteNative( int argCount, Value* args ) {
+    if( !checkArity( "mapDelete", argCount, 2 ) || !checkMap( "mapDelete", args[0] ) ) return NATIVE_ERROR;
+    return BOOL_VAL( mapDelete( AS_MAP( args[0] ), args[1] ) );
+}
+
+// mapSize( map ) => # of keys
+Value mapSizeNative( int argCount, Value* args ) {
+    if( !checkArity( "mapSize", argCount, 1 ) || !checkMap( "mapSize", args[0] ) ) return NATIVE_ERROR;
+    return NUMBER_VAL( (double)AS_MAP( args[0] )->count );
+}
+
+// mapNext( map, key ) => the key after 'key' (pass nil to get the 1st key), or nil once every key has been visited
+// e.g. for( var k = mapNext( m, nil ); k != nil; k = mapNext( m, k ) ) { ... }
+// note: deleting the current key while iterating is fine, but adding keys may rehash the map, which restarts the order
+//  (& makes resuming from a key deleted before that an error)
+Value mapNextNative( int argCount, Value* args ) {
+    if( !checkArity( "mapNext", argCount, 2 ) || !checkMap( "mapNext", args[0] ) ) return NATIVE_ERROR;
+    Value key = args[1];
+    if( mapNext( AS_MAP( args[0] ), &key ) ) return key;
+    runtimeError( "mapNext() key isn't in the map." );
+    return NATIVE_ERROR;
+}
+
+// -- ARRAYS --
+
+static bool checkArray( const char* name, Value value ) {
+    if( IS_ARRAY( value ) ) return true;
+    runtimeError( "%s() expects an array as its first argument.", name );
+    return false;
+}
+
+// len( value ) => # of elements in an array (or Float64Array), # of keys in a map, or # of characters in a string
+Value lenNative( int argCount, Value* args ) {
+    if( !checkArity( "len", argCount, 1 ) ) return NATIVE_ERROR;
+    if( IS_ARRAY( args[0] ) ) return NUMBER_VAL( (double)AS_ARRAY( args[0] )->values.count );
+    if( IS_F64ARRAY( args[0] ) ) return NUMBER_VAL( (double)AS_F64ARRAY( args[0] )->count );
+    if( IS_MAP( args[0] ) ) return NUMBER_VAL( (double)AS_MAP( args[0] )->count );
+    if( isStringValue( args[0] ) ) return NUMBER_VAL( (double)stringValueLength( args[0] ) );
+    runtimeError( "len() expects an array, Float64Array, map or string." );
+    return NATIVE_ERROR;
+}
+
+// push( array, value ) => the array's new length
+Value pushNative( int argCount, Value* args ) {
+    if( !checkArity( "push", argCount, 2 ) || !checkArray( "push", args[0] ) ) return NATIVE_ERROR;
+    ValueArray* values = &AS_ARRAY( args[0] )->values;
+    writeValueArray( values, args[1] ); // note: args are still on the VM stack, so a GC here can see them
+    return NUMBER_VAL( (double)values->count );
+}
+
+// pop( array ) => the removed last element
+Value popNative( int argCount, Value* args ) {
+    if( !checkArity( "pop", argCount, 1 ) || !checkArray( "pop", args[0] ) ) return NATIVE_ERROR;
+    ValueArray* values = &AS_ARRAY( args[0] )->values;
+    if( 0 == values->count ) {
+        runtimeError( "pop() called on an empty array." );
+        return NATIVE_ERROR;
+    }
+    return values->values[--values->count];
+}
+
+// -- STRINGS --
+
+// validates a string argument, & flattens it in place if it's a rope (args live on the VM stack, so it stays reachable)
+static bool checkString( const char* name, Value* arg ) {
+    if( !isStringValue( *arg ) ) {
+        runtimeError( "%s() expects a string.", name );
+        return false;
+    }
+    *arg = flattenValue( *arg );
+    return true;
+}
+
+// validates a character index/offset in [0, max]
+static bool checkOffset( const char* name, Value value, size_t max, size_t* offset ) {
+    if( IS_NUMBER( value ) ) {
+        double num = AS_NUMBER( value );
+        if( num >= 0 && num <= (double)max && (double)(size_t)num == num ) {
+            *offset = (size_t)num;
+            return true;
+        }
+    }
+    runtimeError( "%s() expects an integer offset in [0, %zu].", name, max );
+    return false;
+}
+
+// finds the 1st occurrence of needle in haystack (memchr is vectorized in libc, so it skips to candidates quickly)
+static const char* findChars( const char* haystack, size_t len, const char* needle, size_t needleLen ) {
+    if( 0 == needleLen ) return haystack;
+    if( needleLen > len ) return NULL;
+    const char* last = haystack + len - needleLen; // last possible start of a match
+    for( const char* p = haystack; p <= last; p++ ) {
+        p = memchr( p, needle[0], (size_t)(last - p) + 1 );
+        if( NULL == p ) return NULL;
+        if( 0 == memcmp( p, needle, needleLen ) ) return p;
+    }
+    return NULL;
+}
+
+static bool isSpace( char c ) { return ' ' == c || '\t' == c || '\r' == c || '\n' == c; }
+
+// slice( string, start, end ) => the characters in [start, end) (shares the string's characters when it's big enough, see sliceString)
+Value sliceNative( int argCount, Value* args ) {
+    if( !checkArity( "slice", argCount, 3 ) || !checkString( "slice", &args[0] ) ) return NATIVE_ERROR;
+    size_t len = stringValueLength( args[0] ), start, end;
+    if( !checkOffset( "slice", args[1], len, &start ) || !checkOffset( "slice", args[2], len, &end ) ) return NATIVE_ERROR;
+    if( end < start ) end = start;
+    return sliceString( args[0], start, end - start );
+}
+
+// find( string, needle ) => index of the 1st occurrence of needle, or -1
+Value findNative( int argCount, Value* args ) {
+    if( !checkArity( "find", argCount, 2 ) || !checkString( "find", &args[0] ) || !checkString( "find", &args[1] ) ) return NATIVE_ERROR;
+    char buf[SSO_BUF_SIZE], needleBuf[SSO_BUF_SIZE];
+    const char* s = stringChars( args[0], buf );
+    const char* found = findChars( s, stringValueLength( args[0] ), stringChars( args[1], needleBuf ), stringValueLength( args[1] ) );
+    return NUMBER_VAL( NULL == found ? -1 : (double)(found - s) );
+}
+
+// split( string, separator ) => array of the pieces between separators
+Value splitNative( int argCount, Value* args ) {
+    if( !checkArity( "split", argCount, 2 ) || !checkString( "split", &args[0] ) || !checkString( "split", &args[1] ) ) return NATIVE_ERROR;
+    size_t len = stringValueLength( args[0] ), sepLen = stringValueLength( args[1] );
+    if( 0 == sepLen ) {
+        runtimeError( "split() separator cannot be empty." );
+        return NATIVE_ERROR;
+    }
+
+    // keep the result on the stack while we allocate the pieces
+    ObjArray* array = newArray( NULL, 0 );
+    push( OBJ_VAL( array ) );
+    char buf[SSO_BUF_SIZE], sepBuf[SSO_BUF_SIZE];
+    const char* s = stringChars( args[0], buf );
+    const char* sep = stringChars( args[1], sepBuf );
+    for( size_t start = 0;; ) {
+        const char* found = findChars( s + start, len - start, sep, sepLen );
+        size_t end = NULL == found ? len : (size_t)(found - s);
+        push( sliceString( args[0], start, end - start ) ); // keep the piece reachable while the array grows
+        writeValueArray( &array->values, vm.stackTop[-1] );
+        pop();
+        if( NULL == found ) break;
+        start = end + sepLen;
+    }
+    return pop();
+}
+
+// trim( string ) => the string w/o leading & trailing whitespace
+Value trimNative( int argCount, Value* args ) {
+    if( !checkArity( "trim", argCount, 1 ) || !checkString( "trim", &args[0] ) ) return NATIVE_ERROR;
+    char buf[SSO_BUF_SIZE];
+    const char* s = stringChars( args[0], buf );
+    size_t start = 0, end = stringValueLength( args[0] );
+    while( start < end && isSpace( s[start] ) ) start++;
+    while( end > start && isSpace( s[end - 1] ) ) end--;
+    return sliceString( args[0], start, end - start );
+}
+
+// charCode( string, index ) => the byte at index
+Value charCodeNative( int argCount, Value* args ) {
+    if( !checkArity( "charCode", argCount, 2 ) || !checkString( "charCode", &args[0] ) ) return NATIVE_ERROR;
+    size_t len = stringValueLength( args[0] ), i;
+    if( 0 == len ) {
+        runtimeError( "charCode() called on an empty string." );
+        return NATIVE_ERROR;
+    }
+    if( !checkOffset( "charCode", args[1], len - 1, &i ) ) return NATIVE_ERROR;
+    char buf[SSO_BUF_SIZE];
+    return NUMBER_VAL( (double)(uint8_t)stringChars( args[0], buf )[i] );
+}
+
+// -- FLOAT64ARRAYS --
+
+static bool checkF64Array( const char* name, Value value ) {
+    if( IS_F64ARRAY( value ) ) return true;
+    runtimeError( "%s() expects a Float64Array.", name );
+    return false;
+}
+
+static bool checkNumber( const char* name, Value value ) {
+    if( IS_NUMBER( value ) ) return true;
+    runtimeError( "%s() expects a number.", name );
+    return false;
+}
+
+static bool checkSameLength( const char* name, ObjF64Array* a, ObjF64Array* b ) {
+    if( a->count == b->count ) return true;
+    runtimeError( "%s() expects Float64Arrays of the same length (got %zu and %zu).", name, a->count, b->count );
+    return false;
+}
+
+// Float64Array( n ) => n zeros; Float64Array( array ) => a copy of an array of numbers
+Value f64ArrayNative( int argCount, Value* args ) {
+    if( !checkArity( "Float64Array", argCount, 1 ) ) return NATIVE_ERROR;
+    if( IS_NUMBER( args[0] ) ) {
+        double n = AS_NUMBER( args[0] );
+        if( !(n >= 0) || n != (double)(size_t)n ) {
+            runtimeError( "Float64Array() length must be a non-negative integer." );
+            return NATIVE_ERROR;
+        }
+        return OBJ_VAL( newF64Array( (size_t)n ) );
+    }
+    if( IS_ARRAY( args[0] ) ) {
+        ObjF64Array* result = newF64Array( AS_ARRAY( args[0] )->values.count ); // (the source array is still on the VM stack)
+        Value* values = AS_ARRAY( args[0] )->values.values;
+        for( size_t i = 0; i < result->count; i++ ) {
+            if( !IS_NUMBER( values[i] ) ) {
+                runtimeError( "Float64Array() elements must be numbers." );
+                return NATIVE_ERROR;
+            }
+            result->data[i] = AS_NUMBER( values[i] );
+        }
+        return OBJ_VAL( result );
+    }
+    runtimeError( "Float64Array() expects a length or an array of numbers." );
+    return NATIVE_ERROR;
+}
+
+// f64Sum( x ) => sum of the elements
+Value f64SumNative( int argCount, Value* args ) {
+    if( !checkArity( "f64Sum", argCount, 1 ) || !checkF64Array( "f64Sum", args[0] ) ) return NATIVE_ERROR;
+    ObjF64Array* x = AS_F64ARRAY( args[0] );
+    return NUMBER_VAL( f64.sum( x->data, x->count ) );
+}
+
+// f64Dot( x, y ) => dot product
+Value f64DotNative( int argCount, Value* args ) {
+    if( !checkArity( "f64Dot", argCount, 2 ) || !checkF64Array( "f64Dot", args[0] ) || !checkF64Array( "f64Dot", args[1] ) ) return NATIVE_ERROR;
+    ObjF64Array *x = AS_F64ARRAY( args[0] ), *y = AS_F64ARRAY( args[1] );
+    if( !checkSameLength( "f64Dot", x, y ) ) return NATIVE_ERROR;
+    return NUMBER_VAL( f64.dot( x->data, y->data, x->count ) );
+}
+
+// f64Min( x ) => smallest element (nil if empty)
+Value f64MinNative( int argCount, Value* args ) {
+    if( !checkArity( "f64Min", argCount, 1 ) || !checkF64Array( "f64Min", args[0] ) ) return NATIVE_ERROR;
+    ObjF64Array* x = AS_F64ARRAY( args[0] );
+    return 0 == x->count ? NIL_VAL : NUMBER_VAL( f64.min( x->data, x->count ) );
+}
+
+// f64Max( x ) => largest element (nil if empty)
+Value f64MaxNative( int argCount, Value* args ) {
+    if( !checkArity( "f64Max", argCount, 1 ) || !checkF64Array( "f64Max", args[0] ) ) return NATIVE_ERROR;
+    ObjF64Array* x = AS_F64ARRAY( args[0] );
+    return 0 == x->count ? NIL_VAL : NUMBER_VAL( f64.max( x->data, x->count ) );
+}
+
+// f64Axpy( a, x, y ) => y, after y = a * x + y
+Value f64AxpyNative( int argCount, Value* args ) {
+    if( !checkArity( "f64Axpy", argCount, 3 ) || !checkNumber( "f64Axpy", args[0] ) ||
+        !checkF64Array( "f64Axpy", args[1] ) || !checkF64Array( "f64Axpy", args[2] ) ) return NATIVE_ERROR;
+    ObjF64Array *x = AS_F64ARRAY( args[1] ), *y = AS_F64ARRAY( args[2] );
+    if( !checkSameLength( "f64Axpy", x, y ) ) return NATIVE_ERROR;
+    f64.axpy( AS_NUMBER( args[0] ), x->data, y->data, x->count );
+    return args[2];
+}
+
+// f64Scale( a, x ) => x, after x = a * x (scalars come first, like f64Axpy's)
+Value f64ScaleNative( int argCount, Value* args ) {
+    if( !checkArity( "f64Scale", argCount, 2 ) || !checkNumber( "f64Scale", args[0] ) || !checkF64Array( "f64Scale", args[1] ) ) return NATIVE_ERROR;
+    ObjF64Array* x = AS_F64ARRAY( args[1] );
+    f64.scale( AS_NUMBER( args[0] ), x->data, x->count );
+    return args[1];
+}
+
+// shared by f64Add & f64Mul: validates ( dst, x, y ) and runs the elementwise kernel
+static Value elementwise( const char* name, int argCount, Value* args,
+                          void (*kernel)( double* dst, const double* x, const double* y, size_t n ) ) {
+    if( !checkArity( name, argCount, 3 ) || !checkF64Array( name, args[0] ) ||
+        !checkF64Array( name, args[1] ) || !checkF64Array( name, args[2] ) ) return NATIVE_ERROR;
+    ObjF64Array *dst = AS_F64ARRAY( args[0] ), *x = AS_F64ARRAY( args[1] ), *y = AS_F64ARRAY( args[2] );
+    if( !checkSameLength( name, dst, x ) || !checkSameLength( name, x, y ) ) return NATIVE_ERROR;
+    kernel( dst->data, x->data, y->data, dst->count );
+    return args[0];
+}
+
+// f64Add( dst, x, y ) => dst, after dst = x + y
+Value f64AddNative( int argCount, Value* args ) { return elementwise( "f64Add", argCount, args, f64.add ); }
+
+// f64Mul( dst, x, y ) => dst, after dst = x * y
+Value f64MulNative( int argCount, Value* args ) { return elementwise( "f64Mul", argCount, args, f64.mul ); }
+
+// -- MATH --
+
+// sqrt( x ) => the square root of x
+Value sqrtNative( int argCount, Value* args ) {
+    if( !checkArity( "sqrt", argCount, 1 ) || !checkNumber( "sqrt", args[0] ) ) return NATIVE_ERROR;
+    return NUMBER_VAL( sqrt( AS_NUMBER( args[0] ) ) );
+}
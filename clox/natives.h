@@ -0,0 +1,41 @@
+#pragma once
+#include "value.h"
+
+// native functions exposed to scripts (registered w/ defineNative in vm.c)
+// a native reports a runtime error by calling runtimeError and returning ERROR_VAL( RUNTIME_ERROR )
+
+// misc
+Value clockNative( int argCount, Value* args );
+Value sqrtNative( int argCount, Value* args );
+
+// maps
+Value mapNative( int argCount, Value* args );
+Value mapGetNative( int argCount, Value* args );
+Value mapSetNative( int argCount, Value* args );
+Value mapHasNative( int argCount, Value* args );
+Value mapDeleteNative( int argCount, Value* args );
+Value mapSizeNative( int argCount, Value* args );
+Value mapNextNative( int argCount, Value* args );
+
+// arrays
+Value lenNative( int argCount, Value* args );
+Value pushNative( int argCount, Value* args );
+Value popNative( int argCount, Value* args );
+
+// strings
+Value sliceNative( int argCount, Value* args );
+Value findNative( int argCount, Value* args );
+Value splitNative( int argCount, Value* args );
+Value trimNative( int argCount, Value* args );
+Value charCodeNative( int argCount, Value* args );
+
+// Float64Arrays
+Value f64ArrayNative( int argCount, Value* args );
+Value f64SumNative( int argCount, Value* args );
+Value f64DotNative( int argCount, Value* args );
+Value f64MinNative( int argCount, Value* args );
+Value f64MaxNative( int argCount, Value* args );
+Value f64AxpyNative( int argCount, Value* args );
+Value f64ScaleNative( int argCount, Value* args );
+Value f64AddNative( int argCount, Value* args );
+Value f64MulNative( int argCount, Value* args );
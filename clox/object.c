@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "memory.h"
 #include "object.h"
@@ -26,9 +27,14 @@ void printObject( Obj* o ) {
             break;
         }
         case OBJ_BOUND_METHOD: {
-            printFunction( ((ObjBoundMethod*)o)->method->function );
+            printObject( ((ObjBoundMethod*)o)->method );
             break;
         }
+        case OBJ_MAP: printf( "<map %zu>", ((ObjMap*)o)->count ); return;
+        case OBJ_ARRAY: printf( "<array %zu>", ((ObjArray*)o)->values.count ); return;
+        case OBJ_F64ARRAY: printf( "<f64array %zu>", ((ObjF64Array*)o)->count ); return;
+        case OBJ_ROPE: printString( flattenRope( (ObjRope*)o ) ); return;
+        case OBJ_SLICE: printf( "\"%.*s\"", (int)((ObjSlice*)o)->len, ((ObjSlice*)o)->chars ); return;
         default: printf( "obj<%p>", o ); return;
     }
 }
@@ -40,6 +46,11 @@ void printObjectType( ObjType type ) {
         case OBJ_FUNCTION: printf( "OBJ_FUNCTION" ); return;
         case OBJ_NATIVE: printf( "OBJ_NATIVE" ); return;
         case OBJ_CLOSURE: printf( "OBJ_CLOSURE" ); return;
+        case OBJ_MAP: printf( "OBJ_MAP" ); return;
+        case OBJ_ARRAY: printf( "OBJ_ARRAY" ); return;
+        case OBJ_F64ARRAY: printf( "OBJ_F64ARRAY" ); return;
+        case OBJ_ROPE: printf( "OBJ_ROPE" ); return;
+        case OBJ_SLICE: printf( "OBJ_SLICE" ); return;
         default: printf( "OBJ_UNKNOWN" ); return;
     }
 }
@@ -88,6 +99,11 @@ ObjClass* newClass( ObjString* name ) {
     ObjClass* class = (ObjClass*)allocateObject( sizeof( ObjClass ), OBJ_CLASS );
     class->name = name;
     initTable( &class->methods );
+    class->vtable = NULL;
+    class->methodCount = class->methodCapacity = 0;
+    class->initializer = NULL;
+    class->fieldHint = 0;
+    class->sampleCount = 0;
     return class;
 }
 
@@ -96,15 +112,23 @@ ObjFunction* newFunction() {
     function->obj.type = OBJ_FUNCTION;
     function->arity = 0;
     function->upvalueCount = 0;
+    function->captureCount = 0;
+    function->maxSlots = 0;
     function->name = NULL;
     initChunk( &function->chunk );
     return function;
 }
 
 ObjInstance* newInstance( ObjClass* class ) {
-    ObjInstance* instance = (ObjInstance*)allocateObject( sizeof( ObjInstance ), OBJ_INSTANCE );
+    // presize the fields based on what previous instances ended up with
+    size_t capacity = 0 == class->fieldHint ? 0 : tableCapacityFor( class->fieldHint );
+    ObjInstance* instance = (ObjInstance*)allocateObject( sizeof( ObjInstance ) + sizeof( Entry ) * capacity, OBJ_INSTANCE );
     instance->class = class;
-    initTable( &instance->fields );
+    instance->inlineCapacity = capacity;
+    instance->isSample = class->sampleCount < CLASS_FIELD_SAMPLES;
+    if( instance->isSample ) class->sampleCount++;
+    if( 0 == capacity ) initTable( &instance->fields );
+    else initTableBorrowed( &instance->fields, instance->inlineFields, capacity );
     return instance;
 }
 
@@ -115,26 +139,55 @@ ObjNative* newNative( NativeFn function ) {
 }
 
 ObjClosure* newClosure( ObjFunction* function ) {
-    // allocate upvalue buffer
-    int upvalueCount = function->upvalueCount;
-    ObjUpvalue** upvalues = (ObjUpvalue**)allocate( sizeof( ObjUpvalue*) * upvalueCount );
-    for( int i = 0; i < upvalueCount; i++ ) upvalues[i] = NULL;
-
-    // allocate closure
-    ObjClosure* closure = (ObjClosure*)allocateObject( sizeof( ObjClosure ), OBJ_CLOSURE );
+    // allocate closure, its upvalues & its captured values in one go
+    int upvalueCount = function->upvalueCount, captureCount = function->captureCount;
+    size_t size = sizeof( ObjClosure ) + sizeof( ObjUpvalue* ) * upvalueCount + sizeof( Value ) * captureCount;
+    ObjClosure* closure = (ObjClosure*)allocateObject( size, OBJ_CLOSURE );
     closure->function = function;
-    closure->upvalues = upvalues;
     closure->upvalueCount = upvalueCount;
+    closure->captureCount = captureCount;
+    closure->captures = (Value*)(closure->upvalues + upvalueCount);
+    for( int i = 0; i < upvalueCount; i++ ) closure->upvalues[i] = NULL;
+    for( int i = 0; i < captureCount; i++ ) closure->captures[i] = NIL_VAL;
     return closure;
 }
 
-ObjBoundMethod* newBoundMethod( Value receiver, ObjClosure* method ) {
+ObjBoundMethod* newBoundMethod( Value receiver, Obj* method ) {
     ObjBoundMethod* bound = (ObjBoundMethod*)allocateObject( sizeof( ObjBoundMethod ), OBJ_BOUND_METHOD );
     bound->receiver = receiver;
     bound->method = method;
     return bound;
 }
 
+ObjMap* newMap() {
+    ObjMap* map = (ObjMap*)allocateObject( sizeof( ObjMap ), OBJ_MAP );
+    map->count = 0;
+    map->load = 0;
+    map->capacity = 0;
+    map->entries = NULL;
+    return map;
+}
+
+ObjArray* newArray( Value* values, size_t count ) {
+    // allocate the element buffer first (a GC here is fine: the caller keeps the initial values reachable)
+    Value* buffer = 0 == count ? NULL : (Value*)allocate( sizeof( Value ) * count );
+
+    // allocate array
+    ObjArray* array = (ObjArray*)allocateObject( sizeof( ObjArray ), OBJ_ARRAY );
+    array->values.capacity = count;
+    array->values.count = count;
+    array->values.values = buffer;
+    if( 0 != count ) memcpy( buffer, values, sizeof( Value ) * count );
+    return array;
+}
+
+ObjF64Array* newF64Array( size_t count ) {
+    ObjF64Array* array = (ObjF64Array*)allocateObject( sizeof( ObjF64Array ) + sizeof( double ) * count, OBJ_F64ARRAY );
+    array->count = count;
+    memset( array->data, 0, sizeof( double ) * count );
+    return array;
+}
+
 static uint32_t hashStringFNV1a32( const char* key, size_t len, uint32_t hash ) {
     for( size_t i = 0; i < len; i++ ) {
         hash ^= (uint8_t)key[i];
@@ -147,29 +200,236 @@ ObjString* makeString( const char* s, size_t len ) {
     return concatStrings( s, len, NULL, 0 );
 }
 
+// allocates an (un-interned, un-hashed) string w/ room for len characters
+static ObjString* allocateString( size_t len ) {
+    ObjString* obj = (ObjString*)allocateObject( sizeof( ObjString ) + len, OBJ_STRING );
+    obj->len = len;
+    obj->hash = 0;
+    obj->isHashed = false;
+    obj->isInterned = false;
+    return obj;
+}
+
+// adds a (hashed) string to the intern set
+static void addInterned( ObjString* s ) {
+    s->isInterned = true;
+    push( OBJ_VAL( s ) ); // ensure GC can see this object BEFORE we call stringSetAdd (which might trigger a GC)
+    stringSetAdd( &vm.strings, s );
+    pop();
+}
+
+uint32_t stringHash( ObjString* s ) {
+    if( !s->isHashed ) {
+        s->hash = hashStringFNV1a32( s->buf, s->len, HASH_SEED );
+        s->isHashed = true;
+    }
+    return s->hash;
+}
+
+ObjString* newString( const char* s1, size_t len1, const char* s2, size_t len2 ) {
+    ObjString* obj = allocateString( len1 + len2 );
+    memcpy( obj->buf, s1, len1 );
+    memcpy( obj->buf + len1, s2, len2 );
+    return obj;
+}
+
+bool stringsEqual( ObjString* a, ObjString* b ) {
+    if( a == b ) return true;
+    if( a->isInterned && b->isInterned ) return false;
+    if( a->len != b->len ) return false;
+    if( a->isHashed && b->isHashed && a->hash != b->hash ) return false;
+    return 0 == memcmp( a->buf, b->buf, a->len );
+}
+
 ObjString* concatStrings( const char* s1, size_t len1, const char* s2, size_t len2 ) {
     // compute hash
     uint32_t hash = hashStringFNV1a32( s2, len2, hashStringFNV1a32( s1, len1, HASH_SEED ) );
 
     // find string in table
-    ObjString* obj = tableFindString( &vm.strings, hash, s1, len1, s2, len2 );
+    ObjString* obj = stringSetFind( &vm.strings, hash, s1, len1, s2, len2 );
     if( NULL != obj ) return obj;
 
-    // otherwise, allocate a new string
-    int len = len1 + len2;
-    obj = (ObjString*)allocateObject( sizeof( ObjString ) + len, OBJ_STRING );
-    obj->len = len;
+    // otherwise, allocate a new string & intern it
+    obj = newString( s1, len1, s2, len2 );
     obj->hash = hash;
-    memcpy( obj->buf, s1, len1 );
-    memcpy( obj->buf + len1, s2, len2 );
-
-    // intern it
-    push( OBJ_VAL( obj ) ); // ensure GC can see this object BEFORE we call tableSet (which might trigger a GC)
-    tableSet( &vm.strings, obj, NIL_VAL );
-    pop();
+    obj->isHashed = true;
+    addInterned( obj );
     return obj;
 }
 
+size_t stringValueLength( Value value ) {
+    if( IS_SSO( value ) ) return SSO_LEN( value );
+    Obj* obj = AS_OBJ( value );
+    switch( obj->type ) {
+        case OBJ_STRING: return ((ObjString*)obj)->len;
+        case OBJ_ROPE: return ((ObjRope*)obj)->len;
+        case OBJ_SLICE: return ((ObjSlice*)obj)->len;
+        default: return 0; // unreachable
+    }
+}
+
+// characters of a flat heap string (ObjString or ObjSlice)
+static const char* objChars( Obj* obj, size_t* len ) {
+    if( OBJ_SLICE == obj->type ) {
+        *len = ((ObjSlice*)obj)->len;
+        return ((ObjSlice*)obj)->chars;
+    }
+    *len = ((ObjString*)obj)->len;
+    return ((ObjString*)obj)->buf;
+}
+
+const char* stringChars( Value value, char* buf ) {
+    if( IS_SSO( value ) ) {
+        ssoChars( value, buf );
+        return buf;
+    }
+    size_t len;
+    return objChars( AS_OBJ( value ), &len );
+}
+
+Value makeStringValue( const char* s, size_t len ) {
+    return FITS_SSO( len ) ? ssoVal( s, len ) : OBJ_VAL( makeString( s, len ) );
+}
+
+Value newStringValue( const char* s1, size_t len1, const char* s2, size_t len2 ) {
+    if( !FITS_SSO( len1 + len2 ) ) return OBJ_VAL( newString( s1, len1, s2, len2 ) );
+    char buf[SSO_BUF_SIZE];
+    memcpy( buf, s1, len1 );
+    memcpy( buf + len1, s2, len2 );
+    return ssoVal( buf, len1 + len2 );
+}
+
+bool stringValuesEqual( Value a, Value b ) {
+    #ifdef NAN_BOXING
+    if( IS_SSO( a ) && IS_SSO( b ) ) return a == b; // short strings are canonical
+    #endif
+    size_t len = stringValueLength( a );
+    if( len != stringValueLength( b ) ) return false;
+    if( IS_STRING( a ) && IS_STRING( b ) ) return stringsEqual( AS_STRING( a ), AS_STRING( b ) );
+
+    // mixed forms of the same length (e.g. a short string vs an identifier, or a slice vs anything)
+    char bufA[SSO_BUF_SIZE], bufB[SSO_BUF_SIZE];
+    return 0 == memcmp( stringChars( a, bufA ), stringChars( b, bufB ), len );
+}
+
+uint32_t stringValueHash( Value value ) {
+    if( IS_SSO( value ) ) {
+        char buf[SSO_BUF_SIZE];
+        ssoChars( value, buf );
+        return hashStringFNV1a32( buf, SSO_LEN( value ), HASH_SEED ); // same hash as the heap form
+    }
+    if( IS_SLICE( value ) ) {
+        ObjSlice* slice = AS_SLICE( value );
+        if( !slice->isHashed ) {
+            slice->hash = hashStringFNV1a32( slice->chars, slice->len, HASH_SEED );
+            slice->isHashed = true;
+        }
+        return slice->hash;
+    }
+    return stringHash( AS_STRING( value ) );
+}
+
+Value sliceString( Value value, size_t start, size_t len ) {
+    // copy short or sparse substrings (note: short strings can only produce short substrings)
+    char buf[SSO_BUF_SIZE];
+    const char* chars = stringChars( value, buf ) + start;
+    if( IS_SSO( value ) || len < SLICE_MIN_LEN ) return newStringValue( chars, len, NULL, 0 );
+    ObjString* parent = IS_SLICE( value ) ? AS_SLICE( value )->parent : AS_STRING( value );
+    if( parent->len > SLICE_MAX_WASTE * len ) return newStringValue( chars, len, NULL, 0 );
+
+    // otherwise, share the parent's characters (the parent stays reachable through value while we allocate)
+    ObjSlice* slice = (ObjSlice*)allocateObject( sizeof( ObjSlice ), OBJ_SLICE );
+    slice->len = len;
+    slice->parent = parent;
+    slice->chars = chars;
+    slice->hash = 0;
+    slice->isHashed = false;
+    return OBJ_VAL( slice );
+}
+
+// rope children must be objects: short strings get boxed into heap strings (& pushed, so the GC can see them)
+static Obj* ropeChild( Value value ) {
+    if( IS_SSO( value ) ) {
+        char buf[SSO_BUF_SIZE];
+        ssoChars( value, buf );
+        ObjString* s = newString( buf, SSO_LEN( value ), NULL, 0 );
+        push( OBJ_VAL( s ) );
+        return (Obj*)s;
+    }
+
+    // point at flattened ropes' strings directly, to keep the tree shallow
+    Obj* obj = AS_OBJ( value );
+    return OBJ_ROPE == obj->type && NULL != ((ObjRope*)obj)->flat ? (Obj*)((ObjRope*)obj)->flat : obj;
+}
+
+Value concatValues( Value a, Value b ) {
+    // short results are cheaper to copy right away (note: both sides must be flat, since ropes are at least ROPE_MIN_LEN long)
+    size_t lenA = stringValueLength( a ), lenB = stringValueLength( b );
+    if( lenA + lenB < ROPE_MIN_LEN ) {
+        char bufA[SSO_BUF_SIZE], bufB[SSO_BUF_SIZE];
+        return newStringValue( stringChars( a, bufA ), lenA, stringChars( b, bufB ), lenB );
+    }
+
+    // otherwise, build a rope node
+    Value* top = vm.stackTop;
+    Obj* left = ropeChild( a );
+    Obj* right = ropeChild( b );
+    ObjRope* rope = (ObjRope*)allocateObject( sizeof( ObjRope ), OBJ_ROPE );
+    rope->len = lenA + lenB;
+    rope->left = left;
+    rope->right = right;
+    rope->flat = NULL;
+    vm.stackTop = top; // pop any boxed children
+    return OBJ_VAL( rope );
+}
+
+// copies a rope's characters into buf, filling from the end
+// walking right-to-left means the usual left-deep rope (built by appending in a loop) needs no pending-node stack
+static void copyRope( ObjRope* rope, char* buf ) {
+    char* end = buf + rope->len;
+    Obj** pending = NULL;
+    size_t pendingCount = 0, pendingCapacity = 0;
+    for( Obj* node = (Obj*)rope;; ) {
+        // descend into unflattened ropes: copy the right side first, & remember the left side for later
+        if( OBJ_ROPE == node->type && NULL == ((ObjRope*)node)->flat ) {
+            if( pendingCapacity < pendingCount + 1 ) {
+                pendingCapacity = growCapacity( pendingCapacity );
+                pending = (Obj**)realloc( pending, sizeof( Obj* ) * pendingCapacity ); // scratch memory (not owned by the GC)
+                if( NULL == pending ) exit( 1 );
+            }
+            pending[pendingCount++] = ((ObjRope*)node)->left;
+            node = ((ObjRope*)node)->right;
+            continue;
+        }
+
+        // copy a flat string
+        size_t len;
+        const char* chars = objChars( OBJ_ROPE == node->type ? (Obj*)((ObjRope*)node)->flat : node, &len );
+        end -= len;
+        memcpy( end, chars, len );
+        if( 0 == pendingCount ) break;
+        node = pending[--pendingCount];
+    }
+    free( pending );
+}
+
+ObjString* flattenRope( ObjRope* rope ) {
+    if( NULL != rope->flat ) return rope->flat;
+
+    // copy the characters into a new (un-interned) string (the rope keeps its children alive through this allocation)
+    ObjString* flat = allocateString( rope->len );
+    copyRope( rope, flat->buf );
+
+    // cache the result & drop the children
+    rope->flat = flat;
+    rope->left = rope->right = NULL;
+    return flat;
+}
+
+Value flattenValue( Value value ) {
+    return IS_ROPE( value ) ? OBJ_VAL( flattenRope( AS_ROPE( value ) ) ) : value;
+}
+
 ObjUpvalue* newUpvalue( Value* slot ) {
     ObjUpvalue* upvalue = (ObjUpvalue*)allocateObject( sizeof( ObjUpvalue ), OBJ_UPVALUE );
     upvalue->closed = NIL_VAL;
@@ -3,15 +3,27 @@
 #include "chunk.h"
 #include "value.h"
 #include "table.h"
+#include "map.h"
 
 #define OBJ_TYPE(value)         (AS_OBJ(value)->type)
+#ifdef NAN_BOXING
+#define IS_STRING(value)        IS_OBJ_TAGGED(value, OBJTAG_STRING)
+#define IS_CLOSURE(value)       IS_OBJ_TAGGED(value, OBJTAG_CLOSURE)
+#define IS_INSTANCE(value)      IS_OBJ_TAGGED(value, OBJTAG_INSTANCE)
+#else
 #define IS_STRING(value)        isObjType(value, OBJ_STRING)
+#define IS_CLOSURE(value)       isObjType(value, OBJ_CLOSURE)
+#define IS_INSTANCE(value)      isObjType(value, OBJ_INSTANCE)
+#endif
 #define IS_FUNCTION(value)      isObjType(value, OBJ_FUNCTION)
 #define IS_NATIVE(value)        isObjType(value, OBJ_NATIVE)
-#define IS_CLOSURE(value)       isObjType(value, OBJ_CLOSURE)
 #define IS_CLASS(value)         isObjType(value, OBJ_CLASS)
-#define IS_INSTANCE(value)      isObjType(value, OBJ_INSTANCE)
 #define IS_BOUND_METHOD(value)  isObjType(value, OBJ_BOUND_METHOD)
+#define IS_MAP(value)           isObjType(value, OBJ_MAP)
+#define IS_ARRAY(value)         isObjType(value, OBJ_ARRAY)
+#define IS_F64ARRAY(value)      isObjType(value, OBJ_F64ARRAY)
+#define IS_ROPE(value)          isObjType(value, OBJ_ROPE)
+#define IS_SLICE(value)         isObjType(value, OBJ_SLICE)
 #define AS_STRING(value)        ((ObjString*)AS_OBJ(value))
 #define AS_FUNCTION(value)      ((ObjFunction*)AS_OBJ(value))
 #define AS_NATIVE(value)        (((ObjNative*)AS_OBJ(value))->function)
@@ -19,8 +31,18 @@
 #define AS_CLASS(value)         ((ObjClass*)AS_OBJ(value))
 #define AS_INSTANCE(value)      ((ObjInstance*)AS_OBJ(value))
 #define AS_BOUND_METHOD(value)  ((ObjBoundMethod*)AS_OBJ(value))
+#define AS_MAP(value)           ((ObjMap*)AS_OBJ(value))
+#define AS_ARRAY(value)         ((ObjArray*)AS_OBJ(value))
+#define AS_F64ARRAY(value)      ((ObjF64Array*)AS_OBJ(value))
+#define AS_ROPE(value)          ((ObjRope*)AS_OBJ(value))
+#define AS_SLICE(value)         ((ObjSlice*)AS_OBJ(value))
 #define HASH_SEED 2166136261u
 #define HASH_PRIME 16777619
+#define ROPE_MIN_LEN 64 // concatenations shorter than this are copied right away, instead of building a rope
+#define CLASS_MAX_FIELD_HINT 64 // instances are never preallocated w/ room for more fields than this
+#define CLASS_FIELD_SAMPLES 8 // a class's fieldHint is learned from this many of its 1st instances (later ones don't count)
+#define SLICE_MIN_LEN 32 // substrings shorter than this are copied, instead of sharing the parent's characters
+#define SLICE_MAX_WASTE 4 // a slice only shares its parent's characters if parent len <= SLICE_MAX_WASTE * slice len
 
 typedef enum {
     OBJ_STRING,
@@ -30,7 +52,12 @@ typedef enum {
     OBJ_CLOSURE,
     OBJ_CLASS,
     OBJ_INSTANCE,
-    OBJ_BOUND_METHOD
+    OBJ_BOUND_METHOD,
+    OBJ_MAP,
+    OBJ_ARRAY,
+    OBJ_F64ARRAY,
+    OBJ_ROPE,
+    OBJ_SLICE
 } ObjType;
 
 struct Obj {
@@ -42,10 +69,34 @@ struct Obj {
 struct ObjString {
     Obj obj;
     size_t len;
-    uint32_t hash; // upgrade to 64-bit at some point
+    uint32_t hash; // upgrade to 64-bit at some point (only valid once isHashed is set, see stringHash)
+    bool isHashed;
+    bool isInterned; // interned strings are unique, so two interned strings are equal iff they're the same object
     char buf[]; // flexible array member
 };
 
+// lazy concatenation of two strings (each an ObjString or another ObjRope)
+// built by OP_ADD so that appending in a loop is linear. the characters are only copied out by
+//  flattenRope, the first time the rope is compared, printed, or used as a key. after that, the children are dropped
+typedef struct ObjRope {
+    Obj obj;
+    size_t len;
+    Obj *left, *right; // NULL once flattened
+    ObjString* flat; // NULL until flattened
+} ObjRope;
+
+// substring that shares its parent's characters (see sliceString)
+// to bound how much memory a slice can keep alive, small or sparse substrings are copied instead: a slice is only made
+//  when it's at least SLICE_MIN_LEN long & covers at least 1/SLICE_MAX_WASTE of its parent
+typedef struct ObjSlice {
+    Obj obj;
+    size_t len;
+    ObjString* parent; // always a heap string (slices of slices point at the original parent)
+    const char* chars; // points into parent->buf
+    uint32_t hash; // only valid once isHashed is set
+    bool isHashed;
+} ObjSlice;
+
 typedef struct ObjUpvalue {
     Obj obj;
     Value* location;
@@ -56,6 +107,8 @@ typedef struct ObjUpvalue {
 typedef struct {
     Obj obj;
     int arity, upvalueCount;
+    int captureCount; // # of variables captured by value (see ObjClosure)
+    int maxSlots; // most stack slots its locals take up at once (see call)
     Chunk chunk;
     ObjString* name;
 } ObjFunction;
@@ -68,46 +121,131 @@ typedef struct {
     NativeFn function;
 } ObjNative;
 
-// closure object
+// closure object (only made for functions that capture variables: the compiler emits any other function as a plain
+//  ObjFunction constant, which is called directly)
+// variables that are never reassigned are captured by value: their values are copied into captures when the closure
+//  is created, so they need no ObjUpvalue. every other captured variable goes through an upvalue
 typedef struct {
     Obj obj;
     ObjFunction* function;
-    ObjUpvalue** upvalues;
-    int upvalueCount;
+    int upvalueCount, captureCount;
+    Value* captures; // points just past upvalues (in the same allocation)
+    ObjUpvalue* upvalues[]; // flexible array member (allocated w/ the closure)
 } ObjClosure;
 
+// method slot in a class's vtable
+typedef struct {
+    ObjString* name;
+    Obj* method; // ObjClosure or ObjFunction
+} MethodSlot;
+
 // class object
+// methods live in a dense vtable. OP_INHERIT copies the superclass's vtable before the subclass's own methods are
+//  defined, so an inherited method keeps its slot, & an override replaces it in place. call sites cache the slot
+//  they last resolved (see OP_INVOKE), & only fall back to the name => slot table when the cached slot misses
 typedef struct {
     Obj obj;
     ObjString* name;
-    Table methods;
+    Table methods; // method name => NUMBER_VAL( vtable slot )
+    MethodSlot* vtable;
+    int methodCount, methodCapacity;
+    Obj* initializer; // cached 'init' method (NULL if the class has none)
+    size_t fieldHint; // most fields its sampled instances grew to: new instances are allocated w/ room for this many fields
+    int sampleCount; // # of instances sampled so far (see CLASS_FIELD_SAMPLES)
 } ObjClass;
 
 // instance object
+// instances are allocated w/ room for their class's fieldHint fields inline (so the typical instance takes a single
+//  allocation). fields borrows that space until it outgrows it
+// the hint only follows a class's 1st few instances, so an outlier created later can't make every instance after it
+//  carry room for fields it won't use
 typedef struct {
     Obj obj;
     ObjClass* class;
     Table fields; 
+    size_t inlineCapacity; // # of inline entries
+    bool isSample; // its fields count toward its class's fieldHint
+    Entry inlineFields[]; // flexible array member
 } ObjInstance;
 
-// closure bound to an object instance
+// method (an ObjClosure or ObjFunction) bound to an object instance
 typedef struct {
     Obj obj;
     Value receiver; // object instance
-    ObjClosure* method;
+    Obj* method;
 } ObjBoundMethod;
 
+// value-keyed hashmap (see map.h)
+struct ObjMap {
+    Obj obj;
+    size_t count, load, capacity; // count = # of keys, load = # of keys + tombstones
+    MapEntry* entries;
+};
+
+// dynamic array (elements are stored contiguously)
+typedef struct {
+    Obj obj;
+    ValueArray values;
+} ObjArray;
+
+// fixed-size buffer of unboxed doubles (see f64.h for the bulk kernels that operate on it)
+typedef struct {
+    Obj obj;
+    size_t count;
+    double data[]; // flexible array member
+} ObjF64Array;
+
 // objects
 void printObject( Obj* obj );
 void printObjectType( ObjType type );
 void printObjectDebug( Obj* obj );
 static inline bool isObjType( Value value, ObjType type ) { return IS_OBJ(value) && AS_OBJ(value)->type == type; }
 
+#ifdef NAN_BOXING
+static inline Value objVal( Obj* obj ) { // an object's type never changes, so every value boxing it gets the same tag
+    uint64_t tag = 0;
+    switch( obj->type ) {
+        case OBJ_STRING:    tag = OBJTAG_STRING; break;
+        case OBJ_INSTANCE:  tag = OBJTAG_INSTANCE; break;
+        case OBJ_CLOSURE:   tag = OBJTAG_CLOSURE; break;
+        default:            break;
+    }
+    return SIGN_BIT | QNAN | tag | (uint64_t)(uintptr_t)obj;
+}
+#endif
+
 // strings
 void printString( ObjString* s );
 void printStringToErr( ObjString* s );
+// makeString & concatStrings hash & intern right away (for identifiers & literals, which will be used as table keys)
+// runtime strings (from concatenation, flattening ropes, natives, ...) come from newString instead: they start out
+//  un-interned & un-hashed, since most are just printed. they get hashed on first use as a map key, but never
+//  become Table keys (those are always identifiers, made by makeString)
 ObjString* makeString( const char* s, size_t len );
 ObjString* concatStrings( const char* s1, size_t len1, const char* s2, size_t len2 );
+ObjString* newString( const char* s1, size_t len1, const char* s2, size_t len2 );
+uint32_t stringHash( ObjString* s ); // computes the hash on first use
+bool stringsEqual( ObjString* a, ObjString* b );
+
+// string values: short strings (see SSO_MAX_LEN), heap strings, ropes & slices all behave as strings in scripts
+// makeStringValue/newStringValue pick the short form when the string fits (& so don't allocate), otherwise they
+//  behave like makeString/newString
+static inline bool isStringValue( Value value ) {
+    if( IS_SSO( value ) ) return true;
+    if( !IS_OBJ( value ) ) return false;
+    ObjType type = AS_OBJ( value )->type;
+    return OBJ_STRING == type || OBJ_ROPE == type || OBJ_SLICE == type;
+}
+size_t stringValueLength( Value value ); // value must satisfy isStringValue
+const char* stringChars( Value value, char* buf ); // value must be flat (not a rope). buf must hold SSO_BUF_SIZE chars
+Value makeStringValue( const char* s, size_t len );
+Value newStringValue( const char* s1, size_t len1, const char* s2, size_t len2 );
+bool stringValuesEqual( Value a, Value b ); // compares by content (a & b must be flat)
+uint32_t stringValueHash( Value value ); // the same for every form of a string (value must be flat)
+Value sliceString( Value value, size_t start, size_t len ); // value must be flat & reachable by the GC
+Value concatValues( Value a, Value b ); // a & b must satisfy isStringValue, and must be reachable by the GC
+ObjString* flattenRope( ObjRope* rope ); // may allocate, so the rope must be reachable by the GC
+Value flattenValue( Value value ); // flattens ropes, and passes every other value through
 
 // upvalues
 void printUpvalue( ObjUpvalue* upvalue );
@@ -126,4 +264,11 @@ ObjClosure* newClosure( ObjFunction* function );
 // classes
 ObjClass* newClass( ObjString* name );
 ObjInstance* newInstance( ObjClass* class );
-ObjBoundMethod* newBoundMethod( Value receiver, ObjClosure* method );
+ObjBoundMethod* newBoundMethod( Value receiver, Obj* method );
+
+// maps
+ObjMap* newMap();
+
+// arrays
+ObjArray* newArray( Value* values, size_t count ); // copies the initial elements
+ObjF64Array* newF64Array( size_t count ); // zero-filled
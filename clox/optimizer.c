@@ -0,0 +1,613 @@
+#include <stdlib.h>
+#include <string.h>
+#include "optimizer.h"
+#include "ir.h"
+#include "object.h"
+#include "memory.h"
+
+// the optimizer lifts a chunk into a CFG (see ir.h), runs a pipeline of passes over it until none of them change anything,
+//  then lowers it back into the chunk
+#define MAX_ROUNDS 8 // each round can expose more work for the next one, but there's rarely much left after a few
+#define MAX_HOPS 8 // how many jumps to jumps we'll follow (this also stops us from chasing a jump cycle forever)
+
+typedef bool (*IRPass)( IRFunction* ir ); // returns true if it changed anything
+
+// -- CONSTANT FOLDING --
+
+// gets the value pushed by a constant instruction
+static bool constantOf( IRFunction* ir, IRInstruction* instruction, Value* value ) {
+    uint8_t* operands = irOperands( ir, instruction );
+    switch( instruction->op ) {
+        case OP_NIL:            *value = NIL_VAL; return true;
+        case OP_TRUE:           *value = BOOL_VAL( true ); return true;
+        case OP_FALSE:          *value = BOOL_VAL( false ); return true;
+        case OP_SMALLINT:       *value = INT_VAL( (int8_t)operands[0] ); return true;
+        case OP_SMALLINT_16:    *value = INT_VAL( (int16_t)((operands[0] << 8) | operands[1]) ); return true;
+        case OP_CONSTANT:
+            *value = ir->chunk->constants.values[irOperand( ir, instruction )];
+            return IS_NUMBER( *value ) || isStringValue( *value ); // (not functions)
+        default:
+            return false;
+    }
+}
+
+// finds 'value' in the constant pool, or adds it (-1 if its index would be past 'max')
+// (reuses an existing constant if it can: the folded operands usually become unused, but they stay in the pool)
+static int constantIndex( IRFunction* ir, Value value, size_t max ) {
+    ValueArray* constants = &ir->chunk->constants;
+    size_t index = constants->count;
+    for( size_t i = 0; i < constants->count && index == constants->count; i++ ) {
+        Value constant = constants->values[i];
+        if( (IS_NUMBER( value ) && IS_NUMBER( constant )) || (isStringValue( value ) && isStringValue( constant )) ) {
+            if( valuesEqual( constant, value ) ) index = i;
+        }
+    }
+    if( index > max ) return -1;
+    if( index == constants->count ) addConstant( ir->chunk, value );
+    return (int)index;
+}
+
+// makes an instruction that pushes 'value' (false if the constant pool is full)
+static bool pushConstant( IRFunction* ir, Value value, int line, IRInstruction* instruction ) {
+    if( IS_NIL( value ) || IS_BOOL( value ) ) {
+        *instruction = irInstruction( ir, IS_NIL( value ) ? OP_NIL : AS_BOOL( value ) ? OP_TRUE : OP_FALSE, false, NULL, 0, line );
+        return true;
+    }
+    if( IS_INT( value ) && AS_INT( value ) >= INT16_MIN && AS_INT( value ) <= INT16_MAX ) {
+        int32_t i = AS_INT( value );
+        bool isSmall = i >= INT8_MIN && i <= INT8_MAX;
+        uint8_t operands[2] = { (uint8_t)(isSmall ? i : i >> 8), (uint8_t)i };
+        *instruction = irInstruction( ir, isSmall ? OP_SMALLINT : OP_SMALLINT_16, false, operands, isSmall ? 1 : 2, line );
+        return true;
+    }
+
+    int index = constantIndex( ir, value, UINT16_MAX );
+    if( -1 == index ) return false;
+    uint8_t operands[2] = { (uint8_t)(index >> 8), (uint8_t)index };
+    bool wide = index > UINT8_MAX;
+    *instruction = irInstruction( ir, OP_CONSTANT, wide, wide ? operands : operands + 1, wide ? 2 : 1, line );
+    return true;
+}
+
+// the checked op a number-only op (see OP_ADD_NUM) does the same thing as
+static uint8_t checkedOp( uint8_t op ) {
+    switch( op ) {
+        case OP_ADD_NUM:        return OP_ADD;
+        case OP_SUBTRACT_NUM:   return OP_SUBTRACT;
+        case OP_MULTIPLY_NUM:   return OP_MULTIPLY;
+        case OP_DIVIDE_NUM:     return OP_DIVIDE;
+        case OP_GREATER_NUM:    return OP_GREATER;
+        case OP_LESS_NUM:       return OP_LESS;
+        case OP_NEGATE_NUM:     return OP_NEGATE;
+        default:                return op;
+    }
+}
+
+// folds a binary operator on 2 constants, w/ the same results (& int/double choices) as the VM
+static bool foldBinary( uint8_t op, Value a, Value b, Value* result ) {
+    if( OP_EQUAL == op ) { *result = BOOL_VAL( valuesEqual( a, b ) ); return true; }
+    if( OP_ADD == op && isStringValue( a ) && isStringValue( b ) ) {
+        char bufA[SSO_BUF_SIZE], bufB[SSO_BUF_SIZE];
+        size_t lenA = stringValueLength( a ), lenB = stringValueLength( b );
+        char* chars = (char*)malloc( lenA + lenB + 1 );
+        if( NULL == chars ) exit( 1 );
+        memcpy( chars, stringChars( a, bufA ), lenA );
+        memcpy( chars + lenA, stringChars( b, bufB ), lenB );
+        *result = makeStringValue( chars, lenA + lenB );
+        free( chars );
+        return true;
+    }
+    if( !IS_NUMBER( a ) || !IS_NUMBER( b ) ) return false; // leave it for the VM to report
+    if( IS_INT( a ) && IS_INT( b ) ) {
+        int32_t x = AS_INT( a ), y = AS_INT( b ), r;
+        switch( op ) {
+            case OP_ADD:        if( !__builtin_add_overflow( x, y, &r ) ) { *result = INT_VAL( r ); return true; } break;
+            case OP_SUBTRACT:   if( !__builtin_sub_overflow( x, y, &r ) ) { *result = INT_VAL( r ); return true; } break;
+            case OP_MULTIPLY:   if( !__builtin_mul_overflow( x, y, &r ) && (r != 0 || (x | y) >= 0) ) { *result = INT_VAL( r ); return true; } break;
+            case OP_GREATER:    *result = BOOL_VAL( x > y ); return true;
+            case OP_LESS:       *result = BOOL_VAL( x < y ); return true;
+        }
+    }
+    double x = AS_NUMBER( a ), y = AS_NUMBER( b );
+    switch( op ) {
+        case OP_ADD:        *result = NUMBER_VAL( x + y ); return true;
+        case OP_SUBTRACT:   *result = NUMBER_VAL( x - y ); return true;
+        case OP_MULTIPLY:   *result = NUMBER_VAL( x * y ); return true;
+        case OP_DIVIDE:     *result = NUMBER_VAL( x / y ); return true;
+        case OP_GREATER:    *result = BOOL_VAL( x > y ); return true;
+        case OP_LESS:       *result = BOOL_VAL( x < y ); return true;
+        default:            return false;
+    }
+}
+
+static bool foldUnary( uint8_t op, Value a, Value* result ) {
+    if( OP_NOT == op ) { *result = BOOL_VAL( IS_NIL( a ) || (IS_BOOL( a ) && !AS_BOOL( a )) ); return true; }
+    if( OP_NEGATE != op || !IS_NUMBER( a ) ) return false;
+    if( IS_INT( a ) && AS_INT( a ) != 0 && AS_INT( a ) != INT32_MIN ) *result = INT_VAL( -AS_INT( a ) );
+    else *result = NUMBER_VAL( -AS_NUMBER( a ) );
+    return true;
+}
+
+static bool isBinary( uint8_t op ) {
+    return OP_ADD == op || OP_SUBTRACT == op || OP_MULTIPLY == op || OP_DIVIDE == op || OP_GREATER == op || OP_LESS == op || OP_EQUAL == op;
+}
+
+// copies each block's instructions onto a stack, folding the top of it whenever an operator lands on constants
+// (so '1 + 2 * 3' folds the multiply, then the add)
+static bool foldConstants( IRFunction* ir ) {
+    bool changed = false;
+    for( int b = 0; b < ir->blockCount; b++ ) {
+        IRBlock* block = &ir->blocks[b];
+        if( !block->isLive ) continue;
+        int n = 0;
+        for( int i = 0; i < block->count; i++ ) {
+            IRInstruction* code = block->code;
+            code[n++] = code[i];
+            uint8_t op = checkedOp( code[n - 1].op );
+            int line = code[n - 1].line, inlined = code[n - 1].inlined;
+            Value x, y, result;
+            if( isBinary( op ) && n >= 3 && constantOf( ir, &code[n - 3], &x ) && constantOf( ir, &code[n - 2], &y ) &&
+                foldBinary( op, x, y, &result ) && pushConstant( ir, result, line, &code[n - 3] ) ) {
+                n -= 2;
+                code[n - 1].inlined = inlined;
+                changed = true;
+            } else if( n >= 2 && constantOf( ir, &code[n - 2], &x ) && foldUnary( op, x, &result ) &&
+                       pushConstant( ir, result, line, &code[n - 2] ) ) {
+                n -= 1;
+                code[n - 1].inlined = inlined;
+                changed = true;
+            }
+        }
+        block->count = n;
+    }
+    return changed;
+}
+
+// turns runs of OP_POP (e.g. from endScope) into OP_POPN
+static bool coalescePops( IRFunction* ir ) {
+    bool changed = false;
+    for( int b = 0; b < ir->blockCount; b++ ) {
+        IRBlock* block = &ir->blocks[b];
+        if( !block->isLive ) continue;
+        int n = 0;
+        for( int i = 0; i < block->count; i++ ) {
+            IRInstruction* code = block->code;
+            IRInstruction* last = n > 0 ? &code[n - 1] : NULL;
+            int count = OP_POPN == code[i].op ? irOperands( ir, &code[i] )[0] : 1;
+            if( (OP_POP == code[i].op || OP_POPN == code[i].op) && NULL != last && (OP_POP == last->op || OP_POPN == last->op) ) {
+                int total = count + (OP_POPN == last->op ? irOperands( ir, last )[0] : 1);
+                if( total <= UINT8_MAX ) {
+                    uint8_t operand = (uint8_t)total;
+                    int inlined = last->inlined;
+                    *last = irInstruction( ir, OP_POPN, false, &operand, 1, last->line );
+                    last->inlined = inlined;
+                    changed = true;
+                    continue;
+                }
+            }
+            code[n++] = code[i];
+        }
+        block->count = n;
+    }
+    return changed;
+}
+
+// -- NUMBER TYPES --
+// a forward dataflow analysis: at each point, which stack slots (locals & temporaries) always hold a number? blocks
+//  start out unreached, & a block starts w/ what all of its reached predecessors agree on, so a loop is just visited
+//  again (w/ fewer numbers) until nothing changes. arithmetic on operands that are always numbers then becomes the
+//  unchecked version (OP_ADD_NUM & co)
+// nothing is ever assumed: a number is something we saw produced (a literal, the result of '-', '*' & '/', which can't
+//  produce anything else, or '+' on 2 numbers). parameters, globals, fields, upvalues, call results & locals that a
+//  closure can assign to are never known to be numbers
+
+typedef struct {
+    bool* isNumber; // one per stack slot (from the callee's)
+    int height, capacity; // height is -1 until the block is reached
+} TypeStack;
+
+static void pushType( TypeStack* s, bool isNumber ) {
+    if( s->height + 1 > s->capacity ) {
+        s->capacity = s->capacity < 16 ? 16 : s->capacity * 2;
+        s->isNumber = (bool*)realloc( s->isNumber, sizeof( bool ) * s->capacity );
+        if( NULL == s->isNumber ) exit( 1 );
+    }
+    s->isNumber[s->height++] = isNumber;
+}
+
+static void copyTypes( TypeStack* to, TypeStack* from ) {
+    to->height = 0;
+    for( int i = 0; i < from->height; i++ ) pushType( to, from->isNumber[i] );
+}
+
+// applies an instruction to the stack's types (& makes arithmetic unchecked where it can, if rewrite is set)
+// returns false for anything it doesn't know how to follow
+static bool stepTypes( IRFunction* ir, IRInstruction* instruction, TypeStack* s, bool* escaped, bool rewrite, bool* changed ) {
+    uint8_t* operands = irOperands( ir, instruction );
+    int pops = 0, pushes = 1, needs = 0;
+    bool result = false;
+    #define TOP( n ) s->isNumber[s->height - 1 - (n)]
+    switch( instruction->op ) {
+        case OP_CONSTANT:
+            result = IS_NUMBER( ir->chunk->constants.values[irOperand( ir, instruction )] );
+            break;
+        case OP_SMALLINT: case OP_SMALLINT_16:
+            result = true;
+            break;
+        case OP_NIL: case OP_TRUE: case OP_FALSE: case OP_GET_GLOBAL: case OP_GET_UPVALUE: case OP_GET_CAPTURE:
+        case OP_CLOSURE: case OP_CLASS: case OP_GET_HOISTED_GLOBAL: case OP_GET_HOISTED_FIELD:
+            break;
+        case OP_HOIST_GLOBAL: case OP_HOIST_FIELD:
+            pushes = 2;
+            break;
+        case OP_POP: case OP_DEFINE_GLOBAL: case OP_PRINT: case OP_CLOSE_UPVALUE: case OP_METHOD: case OP_INHERIT:
+        case OP_RETURN:
+            pops = 1; pushes = 0;
+            break;
+        case OP_POPN:
+            pops = operands[0]; pushes = 0;
+            break;
+        case OP_SET_GLOBAL: case OP_SET_UPVALUE:
+            pushes = 0;
+            break;
+        case OP_GET_LOCAL: case OP_SET_LOCAL: {
+            int slot = irOperand( ir, instruction );
+            if( s->height <= slot || s->height < 1 ) return false;
+            if( OP_SET_LOCAL == instruction->op ) s->isNumber[slot] = !escaped[slot] && TOP( 0 );
+            result = !escaped[slot] && s->isNumber[slot];
+            pops = OP_SET_LOCAL == instruction->op ? 1 : 0; // (a store leaves its value)
+            break;
+        }
+        case OP_GET_PROPERTY: case OP_NOT:
+            pops = 1;
+            break;
+        case OP_GET_SUPER: case OP_EQUAL: case OP_GET_INDEX:
+            pops = 2;
+            break;
+        case OP_SET_PROPERTY: case OP_SET_INDEX: // (leave the value that was stored)
+            pops = OP_SET_PROPERTY == instruction->op ? 2 : 3; needs = 1;
+            if( s->height >= needs ) result = TOP( 0 );
+            break;
+        case OP_GREATER: case OP_LESS: case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY: case OP_DIVIDE:
+        case OP_GREATER_NUM: case OP_LESS_NUM: case OP_ADD_NUM: case OP_SUBTRACT_NUM: case OP_MULTIPLY_NUM: case OP_DIVIDE_NUM: {
+            if( s->height < 2 ) return false;
+            uint8_t op = checkedOp( instruction->op );
+            bool isNumber = (TOP( 0 ) && TOP( 1 )) || op != instruction->op;
+            if( isNumber && rewrite && op == instruction->op ) {
+                static const uint8_t unchecked[] = { OP_GREATER_NUM, OP_LESS_NUM, OP_ADD_NUM, OP_SUBTRACT_NUM, OP_MULTIPLY_NUM, OP_DIVIDE_NUM };
+                instruction->op = unchecked[op - OP_GREATER];
+                *changed = true;
+            }
+            pops = 2; result = OP_GREATER != op && OP_LESS != op && (OP_ADD != op || isNumber); // ('+' also concatenates)
+            break;
+        }
+        case OP_NEGATE: case OP_NEGATE_NUM:
+            if( s->height < 1 ) return false;
+            if( OP_NEGATE == instruction->op && TOP( 0 ) && rewrite ) {
+                instruction->op = OP_NEGATE_NUM;
+                *changed = true;
+            }
+            pops = 1; result = true;
+            break;
+        case OP_CALL: case OP_ARRAY:
+            pops = operands[0] + (OP_CALL == instruction->op ? 1 : 0);
+            break;
+        case OP_INVOKE: case OP_SUPER_INVOKE: // (+ the receiver, & the superclass for super)
+            pops = operands[instruction->wide ? 2 : 1] + (OP_INVOKE == instruction->op ? 1 : 2);
+            break;
+        case OP_PEEK: case OP_INLINE_RETURN: // (an inlined call's result replaces its callee & arguments)
+            if( s->height <= operands[0] ) return false;
+            result = TOP( OP_PEEK == instruction->op ? operands[0] : 0 );
+            pops = OP_PEEK == instruction->op ? 0 : operands[0] + 1;
+            break;
+        default:
+            return false;
+    }
+    #undef TOP
+    if( s->height < pops || s->height < needs ) return false;
+    s->height -= pops;
+    for( int i = 0; i < pushes; i++ ) pushType( s, result );
+    return true;
+}
+
+// merges the types at the end of a block into a successor's entry (false if the heights don't match)
+static bool mergeTypes( TypeStack* entry, TypeStack* s, bool* changed ) {
+    if( -1 == entry->height ) {
+        copyTypes( entry, s );
+        *changed = true;
+        return true;
+    }
+    if( entry->height != s->height ) return false;
+    for( int i = 0; i < s->height; i++ ) {
+        if( entry->isNumber[i] && !s->isNumber[i] ) {
+            entry->isNumber[i] = false;
+            *changed = true;
+        }
+    }
+    return true;
+}
+
+// finds locals a closure can assign to (its upvalues, as opposed to the names it captures by value)
+static void findEscaped( IRFunction* ir, bool* escaped ) {
+    for( int b = 0; b < ir->blockCount; b++ ) {
+        IRBlock* block = &ir->blocks[b];
+        for( int i = 0; block->isLive && i < block->count; i++ ) {
+            IRInstruction* instruction = &block->code[i];
+            if( OP_CLOSURE != instruction->op ) continue;
+            uint8_t* operands = irOperands( ir, instruction );
+            ObjFunction* function = AS_FUNCTION( ir->chunk->constants.values[irOperand( ir, instruction )] );
+            int at = instruction->wide ? 2 : 1;
+            for( int j = 0; j < function->upvalueCount; j++ ) {
+                bool isWide = operands[at] & 2;
+                int index = isWide ? (operands[at + 1] << 8) | operands[at + 2] : operands[at + 1];
+                if( operands[at] & 1 ) escaped[index] = true;
+                at += isWide ? 3 : 2;
+            }
+        }
+    }
+}
+
+static bool inferNumbers( IRFunction* ir ) {
+    TypeStack* entries = (TypeStack*)calloc( ir->blockCount, sizeof( TypeStack ) );
+    int* work = (int*)malloc( sizeof( int ) * ir->blockCount );
+    bool* isQueued = (bool*)calloc( ir->blockCount, sizeof( bool ) );
+    bool* escaped = (bool*)calloc( UINT16_COUNT, sizeof( bool ) );
+    if( NULL == entries || NULL == work || NULL == isQueued || NULL == escaped ) exit( 1 );
+    findEscaped( ir, escaped );
+    for( int b = 0; b < ir->blockCount; b++ ) entries[b].height = -1;
+
+    // the code starts w/ the callee & its parameters
+    entries[0].height = 0;
+    for( int i = 0; i <= ir->arity; i++ ) pushType( &entries[0], false );
+    int workCount = 0;
+    work[workCount++] = 0;
+    isQueued[0] = true;
+
+    // run the blocks until their entries settle (each time a block is queued again, a slot stopped being a number)
+    TypeStack s = { NULL, 0, 0 };
+    bool ok = true, changed = false;
+    while( workCount > 0 && ok ) {
+        int b = work[--workCount];
+        IRBlock* block = &ir->blocks[b];
+        isQueued[b] = false;
+        copyTypes( &s, &entries[b] );
+        for( int i = 0; i < block->count && ok; i++ ) ok = stepTypes( ir, &block->code[i], &s, escaped, false, &changed );
+        if( !ok || EXIT_RETURN == block->exit ) continue;
+
+        // the jump's own effect (a guard's target is after the real call, a counted loop's slots hold numbers after it)
+        int successors[2], count = 0;
+        TypeStack taken = { NULL, 0, 0 };
+        copyTypes( &taken, &s );
+        if( EXIT_BRANCH == block->exit ) {
+            uint8_t* operands = irOperands( ir, &block->branch );
+            if( OP_GUARD_CALL == block->branch.op || OP_GUARD_INVOKE == block->branch.op ) {
+                ok = taken.height > operands[2];
+                if( ok ) {
+                    taken.height -= operands[2];
+                    taken.isNumber[taken.height - 1] = false;
+                }
+            } else if( OP_JUMP_IF_FALSE != block->branch.op ) { // (a constant limit isn't in a slot)
+                int slots = OP_FOR_PREP == block->branch.op || OP_FOR_LOOP == block->branch.op ? 2 : 1;
+                for( int i = 0; i < slots && ok; i++ ) ok = s.height > operands[i];
+                for( int i = 0; i < slots && ok; i++ ) s.isNumber[operands[i]] = taken.isNumber[operands[i]] = !escaped[operands[i]];
+            }
+        }
+        if( EXIT_JUMP == block->exit || EXIT_BRANCH == block->exit ) successors[count++] = block->target;
+        if( EXIT_FALLTHROUGH == block->exit || EXIT_BRANCH == block->exit ) successors[count++] = nextLiveBlock( ir, b );
+        for( int i = 0; i < count && ok; i++ ) {
+            bool isNew = false;
+            if( -1 == successors[i] ) continue;
+            ok = mergeTypes( &entries[successors[i]], 0 == i && EXIT_FALLTHROUGH != block->exit ? &taken : &s, &isNew );
+            if( ok && isNew && !isQueued[successors[i]] ) {
+                work[workCount++] = successors[i];
+                isQueued[successors[i]] = true;
+            }
+        }
+        free( taken.isNumber );
+    }
+
+    // then make the arithmetic that only sees numbers unchecked (in blocks that can be reached)
+    for( int b = 0; b < ir->blockCount && ok; b++ ) {
+        IRBlock* block = &ir->blocks[b];
+        if( !block->isLive || -1 == entries[b].height ) continue;
+        copyTypes( &s, &entries[b] );
+        for( int i = 0; i < block->count; i++ ) stepTypes( ir, &block->code[i], &s, escaped, true, &changed );
+    }
+
+    for( int b = 0; b < ir->blockCount; b++ ) free( entries[b].isNumber );
+    free( entries );
+    free( work );
+    free( isQueued );
+    free( escaped );
+    free( s.isNumber );
+    return changed;
+}
+
+// -- JUMPS & DEAD CODE --
+
+// points jumps at their final destination, past blocks that do nothing but jump (or fall through)
+static bool threadJumps( IRFunction* ir ) {
+    bool changed = false;
+    for( int b = 0; b < ir->blockCount; b++ ) {
+        IRBlock* block = &ir->blocks[b];
+        if( !block->isLive || (EXIT_JUMP != block->exit && EXIT_BRANCH != block->exit) ) continue;
+        int target = block->target;
+        for( int hops = 0; hops < MAX_HOPS; hops++ ) {
+            IRBlock* next = &ir->blocks[target];
+            int to = -1;
+            if( 0 != next->count ) break;
+            if( EXIT_JUMP == next->exit ) to = next->target;
+            else if( EXIT_FALLTHROUGH == next->exit ) to = nextLiveBlock( ir, target );
+            // landing on another conditional jump means the same (falsey) value is still on the stack, so that one
+            //  will be taken as well
+            else if( EXIT_BRANCH == next->exit && OP_JUMP_IF_FALSE == next->branch.op && EXIT_BRANCH == block->exit &&
+                     OP_JUMP_IF_FALSE == block->branch.op ) to = next->target;
+
+            // conditional jumps only go forward
+            if( -1 == to || to == target || (EXIT_BRANCH == block->exit && to <= b) ) break;
+            target = to;
+        }
+        if( target == block->target ) continue;
+        block->target = target;
+        changed = true;
+    }
+    return changed;
+}
+
+// removes blocks that can't be reached from the entry
+static bool removeUnreachable( IRFunction* ir ) {
+    bool* isReachable = (bool*)calloc( ir->blockCount, sizeof( bool ) );
+    int* work = (int*)malloc( sizeof( int ) * ir->blockCount );
+    if( NULL == isReachable || NULL == work ) exit( 1 );
+    int workCount = 0;
+    isReachable[0] = true;
+    work[workCount++] = 0;
+    while( workCount > 0 ) {
+        IRBlock* block = &ir->blocks[work[--workCount]];
+        int successors[2], count = 0;
+        if( EXIT_JUMP == block->exit || EXIT_BRANCH == block->exit ) successors[count++] = block->target;
+        if( EXIT_FALLTHROUGH == block->exit || EXIT_BRANCH == block->exit ) successors[count++] = nextLiveBlock( ir, (int)(block - ir->blocks) );
+        for( int i = 0; i < count; i++ ) {
+            if( -1 == successors[i] || isReachable[successors[i]] ) continue;
+            isReachable[successors[i]] = true;
+            work[workCount++] = successors[i];
+        }
+    }
+
+    bool changed = false;
+    for( int b = 0; b < ir->blockCount; b++ ) {
+        if( ir->blocks[b].isLive && !isReachable[b] ) {
+            ir->blocks[b].isLive = false;
+            changed = true;
+        }
+    }
+    free( isReachable );
+    free( work );
+    return changed;
+}
+
+// -- COUNTED LOOPS --
+// 'for( var i = start; i < limit; i = i + 1 )' (where the limit is a local or a number literal) is how almost every
+//  array gets walked. instead of a condition, a conditional jump & a pop, then an increment, a pop & 2 more jumps, it
+//  becomes OP_FOR_PREP before the body & OP_FOR_LOOP after it, which compare (& increment) the counter in place
+// the compiler lays a for loop out as:
+//  start:  GET_LOCAL i, <limit>, LESS, JUMP_IF_FALSE exit
+//          POP, JUMP body
+//  next:   GET_LOCAL i, SMALLINT 1, ADD, SET_LOCAL i, POP, LOOP start
+//  body:   ..., LOOP next
+//  exit:   POP (the condition), ...
+// so 'start' becomes the OP_FOR_PREP, & a new block right before 'exit' the OP_FOR_LOOP that every jump to 'next' goes
+//  to instead. the rest of that layout (& the exit's pop) goes, which is only safe if nothing else can reach it
+
+// true if the instruction is op (or its unchecked version), w/ a 1 byte operand (unless that's -1)
+static bool isInstruction( IRFunction* ir, IRInstruction* instruction, uint8_t op, int operand ) {
+    return op == checkedOp( instruction->op ) && !instruction->wide && (-1 == operand || operand == irOperands( ir, instruction )[0]);
+}
+
+// the limit's operand: a local's slot, or a literal's constant (-1 if it's neither)
+static int loopLimit( IRFunction* ir, IRInstruction* instruction, bool* isConstant ) {
+    Value value;
+    *isConstant = OP_GET_LOCAL != instruction->op;
+    if( !*isConstant ) return instruction->wide ? -1 : irOperand( ir, instruction );
+    if( !constantOf( ir, instruction, &value ) || !IS_NUMBER( value ) ) return -1;
+    return constantIndex( ir, value, UINT8_MAX );
+}
+
+// counts the edges into each block
+static int* countPredecessors( IRFunction* ir ) {
+    int* count = (int*)calloc( ir->blockCount, sizeof( int ) );
+    if( NULL == count ) exit( 1 );
+    for( int b = 0; b < ir->blockCount; b++ ) {
+        IRBlock* block = &ir->blocks[b];
+        if( !block->isLive ) continue;
+        if( EXIT_JUMP == block->exit || EXIT_BRANCH == block->exit ) count[block->target]++;
+        int next = nextLiveBlock( ir, b );
+        if( (EXIT_FALLTHROUGH == block->exit || EXIT_BRANCH == block->exit) && -1 != next ) count[next]++;
+    }
+    return count;
+}
+
+static bool countLoops( IRFunction* ir ) {
+    bool changed = false;
+    for( int start = 0; start < ir->blockCount; start++ ) {
+        IRBlock* block = &ir->blocks[start];
+        if( !block->isLive || EXIT_BRANCH != block->exit || OP_JUMP_IF_FALSE != block->branch.op || 3 != block->count ) continue;
+
+        // match the layout (the exit's 1st instruction must pop the condition)
+        int pop = nextLiveBlock( ir, start ), next = -1 == pop ? -1 : nextLiveBlock( ir, pop ), exitBlock = block->target;
+        if( -1 == next || !isInstruction( ir, &block->code[0], OP_GET_LOCAL, -1 ) || !isInstruction( ir, &block->code[2], OP_LESS, -1 ) ) continue;
+        int counter = irOperand( ir, &block->code[0] );
+        IRBlock* popBlock = &ir->blocks[pop];
+        IRBlock* nextBlock = &ir->blocks[next];
+        IRBlock* exit = &ir->blocks[exitBlock];
+        if( 1 != popBlock->count || OP_POP != popBlock->code[0].op || EXIT_JUMP != popBlock->exit ) continue;
+        int body = popBlock->target;
+        if( 5 != nextBlock->count || EXIT_JUMP != nextBlock->exit || nextBlock->target != start || body != nextLiveBlock( ir, next ) ) continue;
+        if( !isInstruction( ir, &nextBlock->code[0], OP_GET_LOCAL, counter ) || !isInstruction( ir, &nextBlock->code[1], OP_SMALLINT, 1 ) ||
+            !isInstruction( ir, &nextBlock->code[2], OP_ADD, -1 ) || !isInstruction( ir, &nextBlock->code[3], OP_SET_LOCAL, counter ) ||
+            !isInstruction( ir, &nextBlock->code[4], OP_POP, -1 ) ) continue;
+        if( exitBlock <= body || 0 == exit->count || (OP_POP != exit->code[0].op && OP_POPN != exit->code[0].op) ) continue;
+
+        // the pop & the exit can only be reached from the start (so the body's last block can't fall into the exit)
+        int* predecessors = countPredecessors( ir );
+        bool isAlone = 1 == predecessors[pop] && 1 == predecessors[exitBlock];
+        free( predecessors );
+        if( !isAlone ) continue;
+        bool isConstant;
+        int limit = loopLimit( ir, &block->code[1], &isConstant );
+        if( -1 == limit ) continue;
+
+        // start: test the counter
+        uint8_t operands[2] = { (uint8_t)counter, (uint8_t)limit };
+        block->branch = irInstruction( ir, isConstant ? OP_FOR_PREP_CONSTANT : OP_FOR_PREP, false, operands, 2, block->code[2].line );
+        block->count = 0;
+        popBlock->isLive = nextBlock->isLive = false;
+        if( OP_POP == exit->code[0].op || 1 == irOperands( ir, &exit->code[0] )[0] ) {
+            memmove( exit->code, exit->code + 1, sizeof( IRInstruction ) * --exit->count );
+        } else if( 2 == irOperands( ir, &exit->code[0] )[0] ) {
+            exit->code[0] = irInstruction( ir, OP_POP, false, NULL, 0, exit->code[0].line );
+        } else irOperands( ir, &exit->code[0] )[0]--;
+
+        // end: increment & test it again (instead of going to 'next')
+        int line = nextBlock->code[2].line;
+        int loop = insertBlock( ir, exitBlock );
+        IRBlock* loopBlock = &ir->blocks[loop];
+        loopBlock->exit = EXIT_BRANCH;
+        loopBlock->target = body;
+        loopBlock->branch = irInstruction( ir, isConstant ? OP_FOR_LOOP_CONSTANT : OP_FOR_LOOP, false, operands, 2, line );
+        for( int b = 0; b < ir->blockCount; b++ ) {
+            IRBlock* from = &ir->blocks[b];
+            if( (EXIT_JUMP == from->exit || EXIT_BRANCH == from->exit) && next == from->target ) from->target = loop;
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+// -- PIPELINE --
+
+static const IRPass pipeline[] = {
+    threadJumps,
+    removeUnreachable,
+    foldConstants,
+    coalescePops,
+    #ifdef COUNTED_LOOPS
+    countLoops,
+    #endif
+    #ifdef NUMBER_TYPES
+    inferNumbers,
+    #endif
+};
+
+void optimizeChunk( Chunk* chunk, int arity ) {
+    IRFunction ir;
+    if( !liftChunk( chunk, &ir ) ) return;
+    ir.arity = arity;
+    for( int round = 0; round < MAX_ROUNDS; round++ ) {
+        bool changed = false;
+        for( size_t i = 0; i < sizeof( pipeline ) / sizeof( pipeline[0] ); i++ ) changed |= pipeline[i]( &ir );
+        if( !changed ) break;
+    }
+    lowerIR( &ir );
+    freeIR( &ir );
+}
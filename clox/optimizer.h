@@ -0,0 +1,10 @@
+#pragma once
+#include "chunk.h"
+
+// rewrites a finished function's bytecode after the compiler emitted it: lifts it into a CFG (see ir.h) & runs a pipeline of passes until it settles -
+//  threading jumps to jumps, dropping unreachable blocks, folding constant expressions (including string literal
+//  concatenation), coalescing runs of OP_POP into OP_POPN, turning counted for loops into OP_FOR_PREP & OP_FOR_LOOP &
+//  making arithmetic on values that are always numbers unchecked - then lowers it back, w/ each jump as short as it
+//  can be
+// each instruction keeps the line of the code it came from. only called when OPTIMIZE_BYTECODE is defined (see common.h)
+void optimizeChunk( Chunk* chunk, int arity ); // arity: the function's # of parameters
@@ -3,11 +3,6 @@
 #include "common.h"
 #include "scanner.h"
 
-typedef struct {
-    const char* start, *current;
-    int line;
-} Scanner;
-
 Scanner scanner;
 
 void initScanner( const char* source ) {
@@ -182,6 +177,8 @@ Token scanToken() {
         case ')': return makeToken( TOKEN_RIGHT_PAREN );
         case '{': return makeToken( TOKEN_LEFT_BRACE );
         case '}': return makeToken( TOKEN_RIGHT_BRACE );
+        case '[': return makeToken( TOKEN_LEFT_BRACKET );
+        case ']': return makeToken( TOKEN_RIGHT_BRACKET );
         case ';': return makeToken( TOKEN_SEMICOLON );
         case ',': return makeToken( TOKEN_COMMA );
         case '.': return makeToken( TOKEN_DOT );
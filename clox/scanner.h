@@ -4,6 +4,7 @@ typedef enum {
     // Single-character tokens
     TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
     TOKEN_LEFT_BRACE, TOKEN_RIGHT_BRACE,
+    TOKEN_LEFT_BRACKET, TOKEN_RIGHT_BRACKET,
     TOKEN_COMMA, TOKEN_DOT, TOKEN_MINUS, TOKEN_PLUS,
     TOKEN_SEMICOLON, TOKEN_SLASH, TOKEN_STAR,
 
@@ -34,6 +35,13 @@ typedef struct {
 } Token;
 
 // scanner is more commonly called a lexer
+typedef struct {
+    const char* start, *current;
+    int line;
+} Scanner;
+
+extern Scanner scanner; // (the compiler saves & restores this to look ahead, see scanLoop)
+
 void initScanner( const char* source );
 Token scanToken();
 bool lexemesEqual( Token* a, Token* b ); // true if two tokens have the same lexeme
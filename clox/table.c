@@ -9,10 +9,31 @@ void initTable( Table* table ) {
     table->load = 0;
     table->capacity = 0;
     table->entries = NULL;
+    table->isBorrowed = false;
+}
+
+void initTableBorrowed( Table* table, Entry* entries, size_t capacity ) {
+    // (packed tables don't need their unused entries cleared, but it's cheap)
+    for( size_t i = 0; i < capacity; i++ ) {
+        entries[i].key = NULL;
+        entries[i].value = NIL_VAL;
+    }
+    table->load = 0;
+    table->capacity = capacity;
+    table->entries = entries;
+    table->isBorrowed = true;
+}
+
+size_t tableCapacityFor( size_t count ) {
+    if( count <= TABLE_LINEAR_MIN ) return TABLE_LINEAR_MIN;
+    if( count <= TABLE_LINEAR_MAX ) return TABLE_LINEAR_MAX;
+    size_t capacity = TABLE_LINEAR_MAX << 1;
+    while( count > capacity * TABLE_MAX_LOAD ) capacity <<= 1;
+    return capacity;
 }
 
 void freeTable( Table* table ) {
-    freeArray( sizeof( Entry ), table->entries, table->capacity );
+    if( !table->isBorrowed ) freeArray( sizeof( Entry ), table->entries, table->capacity );
     initTable( table );
 }
 
@@ -36,19 +57,47 @@ static Entry* findEntry( Entry* entries, size_t capacity, ObjString* key ) {
             else if( NULL == t ) t = e;
 
         // otherwise: check for a match
-        // note that we can use reference equality here b/c all ObjString's are interned
+        // note that we can use reference equality here b/c all keys are interned
         } else if( e->key == key ) return e;
     }
 }
 
+// true if the table is small enough to be stored packed (no hashing, no tombstones)
+static inline bool isLinear( Table* table ) { return table->capacity <= TABLE_LINEAR_MAX; }
+
+// # of entries that must be visited when iterating over the table
+static inline size_t tableSpan( Table* table ) { return isLinear( table ) ? table->load : table->capacity; }
+
+// linear scan over a packed table; returns NULL if the key isn't present
+static Entry* findLinear( Table* table, ObjString* key ) {
+    Entry* entries = table->entries;
+    for( size_t i = 0; i < table->load; i++ ) if( entries[i].key == key ) return &entries[i];
+    return NULL;
+}
+
 void tableAddAll( Table* from, Table* to ) {
-    for( size_t i = 0; i < from->capacity; i++ ) {
+    size_t span = tableSpan( from );
+    for( size_t i = 0; i < span; i++ ) {
         Entry* entry = &from->entries[i];
         if( NULL != entry->key ) tableSet( to, entry->key, entry->value );
     }
 }
 
 static void adjustCapacity( Table* table, size_t newCapacity ) {
+    // growing a packed table: no rehash needed, just resize the buffer (or move out of a borrowed one)
+    if( newCapacity <= TABLE_LINEAR_MAX ) {
+        if( table->isBorrowed ) {
+            Entry* entries = growArray( sizeof( Entry ), NULL, 0, newCapacity );
+            memcpy( entries, table->entries, sizeof( Entry ) * table->load );
+            table->entries = entries;
+            table->isBorrowed = false;
+        } else {
+            table->entries = growArray( sizeof( Entry ), table->entries, table->capacity, newCapacity );
+        }
+        table->capacity = newCapacity;
+        return;
+    }
+
     // allocate new entries
     // bugfix: old was just: Entry* newEntries = zallocate( sizeof( Entry ) * newCapacity );
     //         but, now we've redefined NIL_VAL b/c of NaN boxing, so we have to set it (cannot rely on NIL being zero anymore)
@@ -59,8 +108,8 @@ static void adjustCapacity( Table* table, size_t newCapacity ) {
     }
 
     // insert existing entries into the new table
-    size_t newLoad = 0;
-    for( size_t i = 0; i < table->capacity; i++ ) {
+    size_t newLoad = 0, span = tableSpan( table );
+    for( size_t i = 0; i < span; i++ ) {
         // get old entry
         Entry* entry = &table->entries[i];
         if( NULL == entry->key ) continue;
@@ -73,15 +122,41 @@ static void adjustCapacity( Table* table, size_t newCapacity ) {
     }
 
     // free old entries
-    freeArray( sizeof( Entry ), table->entries, table->capacity );
+    if( !table->isBorrowed ) freeArray( sizeof( Entry ), table->entries, table->capacity );
 
     // set new entries buffer
     table->load = newLoad;
     table->capacity = newCapacity;
     table->entries = newEntries;
+    table->isBorrowed = false;
 }
 
 bool tableSet( Table* table, ObjString* key, Value value ) {
+    // packed table: overwrite in place, or append to the end
+    if( isLinear( table ) ) {
+        Entry* entry = findLinear( table, key );
+        if( NULL != entry ) {
+            entry->value = value;
+            return false;
+        }
+        if( table->load < table->capacity ) {
+            entry = &table->entries[table->load++];
+            entry->key = key;
+            entry->value = value;
+            return true;
+        }
+
+        // out of room: double the packed buffer, or upgrade to a hashed table
+        if( table->capacity < TABLE_LINEAR_MAX ) {
+            adjustCapacity( table, table->capacity < TABLE_LINEAR_MIN ? TABLE_LINEAR_MIN : table->capacity << 1 );
+            entry = &table->entries[table->load++];
+            entry->key = key;
+            entry->value = value;
+            return true;
+        }
+        adjustCapacity( table, TABLE_LINEAR_MAX << 1 );
+    }
+
     // grow the table if we exceed our max load
     if( table->load + 1 > table->capacity * TABLE_MAX_LOAD )
         adjustCapacity( table, growCapacity( table->capacity ) );
@@ -104,19 +179,33 @@ bool tableGet( Table* table, ObjString* key, Value* value ) {
     if( 0 == table->load ) return false;
 
     // otherwise, find the entry
-    Entry* entry = findEntry( table->entries, table->capacity, key );
-    if( NULL == entry->key ) return false;
+    Entry* entry = isLinear( table ) ? findLinear( table, key ) : findEntry( table->entries, table->capacity, key );
+    if( NULL == entry || NULL == entry->key ) return false;
 
     // value found, so set it
     *value = entry->value;
     return true;
 }
 
+Entry* tableFind( Table* table, ObjString* key ) {
+    if( 0 == table->load ) return NULL;
+    Entry* entry = isLinear( table ) ? findLinear( table, key ) : findEntry( table->entries, table->capacity, key );
+    return NULL == entry || NULL == entry->key ? NULL : entry;
+}
+
 // TODO: this should be 'remove', and probably should return the value removed to the caller so it can deal with deallocation (if needed)
 bool tableDelete( Table* table, ObjString* key ) {
     // this ensures we don't access the bucket array when it's NULL
     if( 0 == table->load ) return false;
 
+    // packed table: move the last entry into the hole (no tombstones needed)
+    if( isLinear( table ) ) {
+        Entry* entry = findLinear( table, key );
+        if( NULL == entry ) return false;
+        *entry = table->entries[--table->load];
+        return true;
+    }
+
     // otherwise, find the entry
     Entry* entry = findEntry( table->entries, table->capacity, key );
     if( NULL == entry->key ) return false;
@@ -127,39 +216,9 @@ bool tableDelete( Table* table, ObjString* key ) {
     return true;
 }
 
-ObjString* tableFindString( Table* table, uint32_t hash, const char* s1, size_t len1, const char* s2, size_t len2 ) {
-    // combined length
-    size_t len = len1 + len2;
-    
-    // avoid null pointer access
-    if( 0 == table->load ) return NULL;
-
-    // linear probing
-    for( uint32_t i = hash & (table->capacity - 1);; i = (i + 1) & (table->capacity - 1) ) {
-        // get entry
-        Entry* entry = &table->entries[i];
-               
-        // on null => return if true null
-        if( NULL == entry->key ) { if( IS_NIL( entry->value ) ) return NULL; }
-
-        // otherwise: check for a match
-        else if( entry->key->hash == hash &&
-                 entry->key->len == len &&
-                 0 == memcmp( entry->key->buf, s1, len1 ) &&
-                 0 == memcmp( entry->key->buf + len1, s2, len2 ) )
-            return entry->key;
-    }
-}
-
-void tableRemoveWhite(Table* table) {
-    for( size_t i = 0; i < table->capacity; i++ ) {
-        Entry* entry = &table->entries[i];
-        if( NULL != entry->key && !entry->key->obj.isMarked ) tableDelete( table, entry->key );
-    }
-}
-
 void markTable( Table* table ) {
-    for( size_t i = 0; i < table->capacity; i++ ) {
+    size_t span = tableSpan( table );
+    for( size_t i = 0; i < span; i++ ) {
         Entry* entry = &table->entries[i];
         markObject( (Obj*)entry->key );
         markValue( entry->value );
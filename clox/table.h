@@ -3,6 +3,8 @@
 #include "value.h"
 
 #define TABLE_MAX_LOAD 0.75
+#define TABLE_LINEAR_MIN 4 // initial capacity of a table (in linear mode)
+#define TABLE_LINEAR_MAX 8 // tables w/ capacity <= this keep their keys packed & are scanned linearly (no hashing)
 
 typedef struct {
     ObjString* key;
@@ -13,17 +15,22 @@ typedef struct {
 // instead, open addressing (also called closed hashing)
 // the simplest form of which is called linear probing
 // this just means if there's a collision, move ahead until a valid slot is found
+// small tables (most method & field tables) skip all of this: while capacity <= TABLE_LINEAR_MAX, the entries
+//  are packed into entries[0, load) and lookup is just a pointer-compare scan. past that, the table upgrades to hashed mode
 typedef struct {
     size_t load, capacity; // load = # of entries (including tombstones)
     Entry* entries;
+    bool isBorrowed; // entries are owned by someone else (e.g. allocated inline w/ an instance), so they're never freed or resized in place
 } Table;
 
 void initTable( Table* table );
+void initTableBorrowed( Table* table, Entry* entries, size_t capacity ); // capacity must come from tableCapacityFor
+size_t tableCapacityFor( size_t count ); // smallest capacity that holds count entries w/o growing
 void freeTable( Table* table );
 void tableAddAll( Table* from, Table* to );
+// note: keys must be interned (i.e. made by makeString or concatStrings), since entries are matched by pointer
 bool tableSet( Table* table, ObjString* key, Value value );
 bool tableGet( Table* table, ObjString* key, Value* value );
 bool tableDelete( Table* table, ObjString* key );
-ObjString* tableFindString( Table* table, uint32_t hash, const char* s1, size_t len1, const char* s2, size_t len2 );
+Entry* tableFind( Table* table, ObjString* key ); // NULL if missing. entries only move when a key is added or deleted
 void markTable( Table* table );
-void tableRemoveWhite( Table* table );
@@ -1,7 +1,9 @@
 #include <stdio.h>
+#include <string.h>
 #include "memory.h"
 #include "value.h"
 #include "object.h"
+#include "vm.h"
 
 void initValueArray( ValueArray* array ) {
     array->capacity = 0;
@@ -34,6 +36,9 @@ void printValue( Value value ) {
         printf( "nil" );
     } else if( IS_NUMBER( value ) ) {
         printf( "%g", AS_NUMBER( value ) );
+    } else if( IS_SSO( value ) ) {
+        char buf[SSO_BUF_SIZE];
+        printf( "\"%.*s\"", (int)SSO_LEN( value ), stringChars( value, buf ) );
     } else if( IS_OBJ( value ) ) {
         printObject( AS_OBJ( value ) );
     } else if( IS_ERROR( value ) ) {
@@ -61,6 +66,20 @@ void printValue( Value value ) {
 }
 
 bool valuesEqual( Value a, Value b ) {
+    // strings compare by content (runtime strings aren't interned), & ropes must be flattened into strings first
+    // note: both values stay on the stack while flattening, so the GC can't collect either side
+    if( isStringValue( a ) && isStringValue( b ) ) {
+        if( IS_ROPE( a ) || IS_ROPE( b ) ) {
+            push( a );
+            push( b );
+            a = flattenValue( a );
+            b = flattenValue( b );
+            pop();
+            pop();
+        }
+        return stringValuesEqual( a, b );
+    }
+
     #ifdef NAN_BOXING
     if( IS_NUMBER( a ) && IS_NUMBER( b ) ) { // must use this here to ensure that NaN does not equal itself (or, skip it?)
         return AS_NUMBER( a ) == AS_NUMBER( b );
@@ -72,9 +91,49 @@ bool valuesEqual( Value a, Value b ) {
         case VAL_BOOL:      return AS_BOOL(a) == AS_BOOL(b);
         case VAL_NIL:       return true;
         case VAL_NUMBER:    return AS_NUMBER(a) == AS_NUMBER(b);
-        case VAL_OBJ:       return AS_OBJ(a) == AS_OBJ(b); // reference equality (also, works for string equality due to interning)
+        case VAL_OBJ:       return AS_OBJ(a) == AS_OBJ(b); // reference equality (strings were already handled above)
         case VAL_ERROR:     return AS_ERROR(a) == AS_ERROR(b);
     }
     return false; // unreachable
     #endif
 }
+
+// 64-bit integer finalizer (from MurmurHash3), so that nearby numbers don't land in nearby buckets
+static uint32_t hashBits( uint64_t bits ) {
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdull;
+    bits ^= bits >> 33;
+    bits *= 0xc4ceb9fe1a85ec53ull;
+    bits ^= bits >> 33;
+    return (uint32_t)bits;
+}
+
+static uint32_t hashNumber( double num ) {
+    uint64_t bits;
+    memcpy( &bits, &num, sizeof( double ) );
+    if( 0 == (bits << 1) ) bits = 0; // -0 == 0, so they must hash the same (checked on the bits, since -ffast-math ignores signed zeros)
+    return hashBits( bits );
+}
+
+uint32_t hashValue( Value value ) {
+    #ifdef NAN_BOXING
+    if( IS_NUMBER( value ) ) return hashNumber( AS_NUMBER( value ) );
+    if( IS_SSO( value ) ) return stringValueHash( value );
+    if( IS_OBJ( value ) ) {
+        if( AS_OBJ( value )->type == OBJ_STRING || AS_OBJ( value )->type == OBJ_SLICE ) return stringValueHash( value );
+        return hashBits( (uint64_t)(uintptr_t)AS_OBJ( value ) );
+    }
+    return hashBits( value ); // nil, bools & errors are singletons
+    #else
+    switch( value.type ) {
+        case VAL_NIL:       return 0;
+        case VAL_BOOL:      return AS_BOOL( value ) ? 1 : 2;
+        case VAL_NUMBER:    return hashNumber( AS_NUMBER( value ) );
+        case VAL_OBJ:
+            if( AS_OBJ( value )->type == OBJ_STRING || AS_OBJ( value )->type == OBJ_SLICE ) return stringValueHash( value );
+            return hashBits( (uint64_t)(uintptr_t)AS_OBJ( value ) );
+        case VAL_ERROR:     return hashBits( (uint64_t)AS_ERROR( value ) );
+    }
+    return 0; // unreachable
+    #endif
+}
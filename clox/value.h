@@ -24,22 +24,60 @@ typedef uint64_t Value;
 #define TRUE_VAL            ((Value)(uint64_t)(QNAN | TAG_TRUE))
 #define BOOL_VAL(b)         ((b) ? TRUE_VAL : FALSE_VAL)
 #define NUMBER_VAL(num)     numToValue(num)
-#define OBJ_VAL(obj)        ((Value)(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(obj)))
+#define OBJ_VAL(obj)        objVal( (Obj*)(obj) ) // tags the hottest object types (see object.h)
 #define ERROR_VAL(err)      ((Value)(uint64_t)(QNAN | err))
 
 // value properties
 #define IS_NIL(value)       ((value) == NIL_VAL)
 #define IS_BOOL(value)      (((value) | 1) == TRUE_VAL)
-#define IS_NUMBER(value)    (((value) & QNAN) != QNAN)
+#define IS_NUMBER(value)    (IS_DOUBLE( value ) || IS_INT( value ))
+#define IS_DOUBLE(value)    (((value) & QNAN) != QNAN)
 #define IS_OBJ(value)       (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
 #define IS_ERROR(value)     (((value) | 8) == (QNAN | RUNTIME_ERROR))
 
+// short strings: up to SSO_MAX_LEN characters are stored in the value itself (no object, no allocation)
+// non-object values use bits 48-49 as a subtag (00 = nil/bools/errors, 01 = short string, 10 = small int). a short
+//  string keeps its characters in bits 0-39 (1st character in the lowest byte, unused bytes zeroed) & its length in
+//  bits 40-42, so two short strings are equal iff their bits are equal
+#define SSO_MAX_LEN         5
+#define SSO_BUF_SIZE        8 // enough room for any 3-bit length (see ssoChars)
+#define TAG_SSO             ((uint64_t)1 << 48)
+#define SUBTAG_MASK         ((uint64_t)3 << 48)
+#define IS_SSO(value)       (((value) & (SIGN_BIT | QNAN | SUBTAG_MASK)) == (QNAN | TAG_SSO))
+#define SSO_LEN(value)      ((size_t)(((value) >> 40) & 7))
+#define FITS_SSO(len)       ((len) <= SSO_MAX_LEN)
+
+// small ints: subtag 10 holds a 32-bit two's complement integer in bits 0-31. integral number literals & the results of
+//  int +, -, * that don't overflow stay ints, everything else is a double. both are "numbers" to the script (AS_NUMBER
+//  converts), so an int & a double with the same value are equal, hash the same & print the same
+#define TAG_INT             ((uint64_t)2 << 48)
+#define IS_INT(value)       (((value) & (SIGN_BIT | QNAN | SUBTAG_MASK)) == (QNAN | TAG_INT))
+#define INT_VAL(i)          ((Value)(QNAN | TAG_INT | (uint64_t)(uint32_t)(int32_t)(i)))
+#define AS_INT(value)       ((int32_t)(uint32_t)(value))
+
+// object values use the same bits 48-49 (pointers only need 48 bits) to tag the hottest object types, so IS_STRING,
+//  IS_INSTANCE & IS_CLOSURE don't have to load obj->type. every other type is tagged 00 & still has to check its type
+#define OBJTAG_STRING       ((uint64_t)1 << 48)
+#define OBJTAG_INSTANCE     ((uint64_t)2 << 48)
+#define OBJTAG_CLOSURE      ((uint64_t)3 << 48)
+#define IS_OBJ_TAGGED(value, tag) (((value) & (SIGN_BIT | QNAN | SUBTAG_MASK)) == (SIGN_BIT | QNAN | (tag)))
+
 // value casting
 #define AS_BOOL(value)      ((value) == TRUE_VAL)
-#define AS_NUMBER(value)    valueToNum(value)
-#define AS_OBJ(value)       ((Obj*)(uintptr_t)((value) & ~(SIGN_BIT | QNAN)))
+#define AS_NUMBER(value)    valueToNumber(value)
+#define AS_OBJ(value)       ((Obj*)(uintptr_t)((value) & ~(SIGN_BIT | QNAN | SUBTAG_MASK)))
 #define AS_ERROR(value)     ((int)(((value) & 12) >> 2))
 
+static inline Value ssoVal( const char* s, size_t len ) { // len must be <= SSO_MAX_LEN
+    Value value = QNAN | TAG_SSO | ((uint64_t)len << 40);
+    for( size_t i = 0; i < len; i++ ) value |= (uint64_t)(uint8_t)s[i] << (8 * i);
+    return value;
+}
+
+static inline void ssoChars( Value value, char* buf ) { // buf must hold SSO_LEN( value ) characters
+    for( size_t i = 0, len = SSO_LEN( value ); i < len; i++ ) buf[i] = (char)(value >> (8 * i));
+}
+
 static inline Value numToValue( double num ) { // seems slow, but compiler should convert this function into a simply copy
     Value value;
     memcpy( &value, &num, sizeof(double) );
@@ -52,6 +90,10 @@ static inline double valueToNum( Value value ) { // seems slow, but compiler sho
     return num;
 }
 
+static inline double valueToNumber( Value value ) { // either kind of number, as a double
+    return IS_INT( value ) ? (double)AS_INT( value ) : valueToNum( value );
+}
+
 #else // -- Without NaN Boxing --
 
 typedef enum {
@@ -97,6 +139,21 @@ typedef struct {
 #define AS_OBJ(value)     ((value).as.obj)
 #define AS_ERROR(value)   ((value).as.error)
 
+// short strings are only packed into NaN-boxed values (every string is an object here)
+#define SSO_MAX_LEN       0
+#define SSO_BUF_SIZE      1
+#define IS_SSO(value)     false
+#define SSO_LEN(value)    ((size_t)0)
+#define FITS_SSO(len)     false
+static inline Value ssoVal( const char* s, size_t len ) { (void)s; (void)len; return NIL_VAL; } // unreachable
+static inline void ssoChars( Value value, char* buf ) { (void)value; (void)buf; } // unreachable
+
+// small ints are also a NaN-boxing only thing (every number is a double here)
+#define IS_DOUBLE(value)  IS_NUMBER(value)
+#define IS_INT(value)     false
+#define INT_VAL(i)        NUMBER_VAL((double)(i))
+#define AS_INT(value)     ((int32_t)AS_NUMBER(value))
+
 #endif
 
 typedef struct {
@@ -109,3 +166,4 @@ void writeValueArray( ValueArray* array, Value value );
 void freeValueArray( ValueArray* array );
 void printValue( Value value );
 bool valuesEqual( Value a, Value b );
+uint32_t hashValue( Value value ); // consistent w/ valuesEqual: equal values hash equally
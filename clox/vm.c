@@ -5,23 +5,19 @@
 #include "vm.h"
 #include "compiler.h"
 #include "memory.h"
+#include "natives.h"
+#include "f64.h"
 #include <string.h>
-#include <time.h>
 
 VM vm; // global variable!
 
-// a simple clock function
-static Value clockNative( int argCount, Value* args ) {
-    return NUMBER_VAL( (double)clock() / CLOCKS_PER_SEC );
-}
-
 static void resetStack() {
     vm.stackTop = vm.stack;
     vm.frameCount = 0;
     vm.openUpvalues = NULL;
 }
 
-static void runtimeError( const char* format, ... ) {
+void runtimeError( const char* format, ... ) {
     // print error message
     va_list args;
     va_start( args, format );
@@ -33,9 +29,19 @@ static void runtimeError( const char* format, ... ) {
     for( int i = vm.frameCount - 1; i >= 0; i-- ) {
         // print line # for stack frame
         CallFrame* frame = &vm.frames[i];
-        ObjFunction* function = frame->closure->function;
+        ObjFunction* function = frame->function;
         size_t instruction = frame->ip - function->chunk.code - 1;
-        fprintf( stderr, "[line %d] in ", function->chunk.lines[instruction] );
+        int line = getLine( &function->chunk, instruction );
+
+        // inlined code has no frame of its own, so print the function it came from, then the line that called it
+        InlineRange* inlined = findInline( &function->chunk, instruction );
+        if( NULL != inlined ) {
+            fprintf( stderr, "[line %d] in ", line );
+            printStringToErr( AS_FUNCTION( function->chunk.constants.values[inlined->function] )->name );
+            fprintf( stderr, "\n" );
+            line = inlined->line;
+        }
+        fprintf( stderr, "[line %d] in ", line );
 
         // print function name
         if ( NULL == function->name ) {
@@ -80,35 +86,57 @@ Value pop() {
 
 static Value peek( int distance ) { return vm.stackTop[-1 - distance]; }
 
-static bool call( ObjClosure* closure, int argCount ) {
+// calls a function, through its closure if it has one (closure is NULL for functions w/o upvalues)
+static bool call( ObjFunction* function, ObjClosure* closure, int argCount ) {
     // sanity check argCount
-    if( argCount != closure->function->arity ) {
-        runtimeError( "Expected %d arguments but got %d.", closure->function->arity, argCount );
+    if( argCount != function->arity ) {
+        runtimeError( "Expected %d arguments but got %d.", function->arity, argCount );
         return false;
     }
 
-    // check for stack overflow
-    if( FRAMES_MAX == vm.frameCount ) { runtimeError( "Stack overflow." ); return false; }
+    // check for stack overflow (a function can have many more locals than the average call's share of the stack)
+    if( FRAMES_MAX == vm.frameCount || vm.stackTop - argCount - 1 + function->maxSlots + STACK_SLACK > vm.stack + STACK_MAX ) {
+        runtimeError( "Stack overflow." );
+        return false;
+    }
 
     // push a new callFrame
     CallFrame* frame = &vm.frames[vm.frameCount++];
+    frame->function = function;
     frame->closure = closure;
-    frame->ip = closure->function->chunk.code;
+    frame->upvalues = NULL == closure ? NULL : closure->upvalues;
+    frame->captures = NULL == closure ? NULL : closure->captures;
+    frame->ip = function->chunk.code;
     frame->slots = vm.stackTop - argCount - 1;
     return true;
 }
 
+// finds a method in a class's vtable
+// slot is the call site's cached vtable slot (or NULL if the site has no cache): if the class has the same method
+//  in that slot, we skip the table lookup. otherwise, we look the slot up by name & update the cache
+static Obj* findMethod( ObjClass* class, ObjString* name, uint8_t* slot ) {
+    if( NULL != slot && *slot < class->methodCount && name == class->vtable[*slot].name ) return class->vtable[*slot].method;
+    Value index;
+    if( !tableGet( &class->methods, name, &index ) ) return NULL;
+    int i = (int)AS_NUMBER( index );
+    if( NULL != slot && i <= UINT8_MAX ) *slot = (uint8_t)i;
+    return class->vtable[i].method;
+}
+
+// calls a method (methods are closures, or plain functions when they don't capture anything)
+static bool callMethod( Obj* method, int argCount ) {
+    if( OBJ_CLOSURE == method->type ) return call( ((ObjClosure*)method)->function, (ObjClosure*)method, argCount );
+    return call( (ObjFunction*)method, NULL, argCount );
+}
+
 static bool callValue( Value callee, int argCount ) {
     if( IS_OBJ( callee ) ) {
         switch( OBJ_TYPE( callee ) ) {
-            case OBJ_FUNCTION: {
-               runtimeError( "Encountered a raw function (should be wrapped in a closure)." );
-                //return call( AS_FUNCTION( callee ), argCount );
-                return false;
-            }
+            case OBJ_FUNCTION:
+                return call( AS_FUNCTION( callee ), NULL, argCount );
 
             case OBJ_CLOSURE:
-                return call( AS_CLOSURE( callee ), argCount );
+                return call( AS_CLOSURE( callee )->function, AS_CLOSURE( callee ), argCount );
 
             case OBJ_CLASS: {
                 // allocate class
@@ -116,9 +144,8 @@ static bool callValue( Value callee, int argCount ) {
                 vm.stackTop[-argCount - 1] = OBJ_VAL( newInstance( class ) );
 
                 // call initializer
-                Value initializer;
-                if( tableGet( &class->methods, vm.initString, &initializer ) ) {
-                    return call( AS_CLOSURE( initializer ), argCount );
+                if( NULL != class->initializer ) {
+                    return callMethod( class->initializer, argCount );
                 } else if( 0 != argCount ) {
                     runtimeError( "Expected 0 arguments but got %d.", argCount );
                     return false;
@@ -129,13 +156,14 @@ static bool callValue( Value callee, int argCount ) {
             case OBJ_BOUND_METHOD: {
                 ObjBoundMethod* bound = AS_BOUND_METHOD( callee );
                 vm.stackTop[-argCount - 1] = bound->receiver; // replace the CallFrame's function (0th slot) w/ the receiver. 'this' points here b/c of the work we did in initCompiler
-                return call( bound->method, argCount );
+                return callMethod( bound->method, argCount );
             }
 
             case OBJ_NATIVE: {
                 // call native function
                 NativeFn native = AS_NATIVE( callee );
                 Value result = native( argCount, vm.stackTop - argCount );
+                if( IS_ERROR( result ) ) return false; // the native already reported the error
 
                 // unwind args
                 vm.stackTop -= argCount + 1;
@@ -151,16 +179,16 @@ static bool callValue( Value callee, int argCount ) {
     return false;
 }
 
-static bool invokeFromClass( ObjClass* class, ObjString* name, int argCount ) {
-    Value method;
-    if( !tableGet( &class->methods, name, &method ) ) {
+static bool invokeFromClass( ObjClass* class, ObjString* name, int argCount, uint8_t* slot ) {
+    Obj* method = findMethod( class, name, slot );
+    if( NULL == method ) {
         runtimeError( "Undefined property '%.*s'", (int)name->len, name->buf );
         return false;
     }
-    return call( AS_CLOSURE( method ), argCount );
+    return callMethod( method, argCount );
 }
 
-static bool invoke( ObjString* name, int argCount ) {
+static bool invoke( ObjString* name, int argCount, uint8_t* slot ) {
     // check that receiver is a class instance
     Value receiver = peek( argCount );
     if( !IS_INSTANCE( receiver ) ) {
@@ -179,24 +207,44 @@ static bool invoke( ObjString* name, int argCount ) {
     }
 
     // otherwise, it must be a method, so invoke a method
-    return invokeFromClass( instance->class, name, argCount );
+    return invokeFromClass( instance->class, name, argCount, slot );
 }
 
 static bool bindMethod( ObjClass* class, ObjString* name ) {
     // lookup the method
-    Value method;
-    if( !tableGet( &class->methods, name, &method ) ) {
+    Obj* method = findMethod( class, name, NULL );
+    if( NULL == method ) {
         runtimeError( "Undefined property '%.*s'", (int)name->len, name->buf );
         return false;
     }
 
     // bind method to class instance, then put bound method on the stack in place of the class instance
-    ObjBoundMethod* bound = newBoundMethod( peek( 0 ), AS_CLOSURE( method ) );
+    // (always a new one: bound methods compare by identity, so reusing one would be visible to '==')
+    ObjBoundMethod* bound = newBoundMethod( peek( 0 ), method );
     pop();
     push( OBJ_VAL( bound ) );
     return true;
 }
 
+// converts a number into an index within [0, count)
+static bool arrayIndex( Value index, size_t count, size_t* i ) {
+    if( IS_INT( index ) && AS_INT( index ) >= 0 && (size_t)AS_INT( index ) < count ) {
+        *i = (size_t)AS_INT( index );
+        return true;
+    }
+    if( !IS_NUMBER( index ) ) {
+        runtimeError( "Array index must be a number." );
+        return false;
+    }
+    double d = AS_NUMBER( index );
+    if( !(d >= 0 && d < (double)count) || d != (double)(size_t)d ) {
+        runtimeError( "Array index %g out of bounds [0, %zu).", d, count );
+        return false;
+    }
+    *i = (size_t)d;
+    return true;
+}
+
 static ObjUpvalue* captureUpvalue( Value* local ) {
     // see if another closure has already captured this upvalue, so it can be shared
     // (note: since list is sorted by upvalue->location, we don't have to keep searching once upvalue->location > local)
@@ -226,9 +274,28 @@ static void closeUpvalues( Value* last ) {
 }
 
 static void defineMethod( ObjString* name ) {
-    Value method = peek( 0 ); // grab function we compiled from top of stack
+    Obj* method = AS_OBJ( peek( 0 ) ); // grab function we compiled from top of stack
     ObjClass* class = AS_CLASS( peek( 1 ) ); // grab class from second-to-top of stack
-    tableSet( &class->methods, name, method ); // bind method to class
+
+    if( name == vm.initString ) class->initializer = method;
+
+    // overriding an inherited method replaces it in its slot (so the slot means the same thing in every subclass)
+    Value index;
+    if( tableGet( &class->methods, name, &index ) ) {
+        class->vtable[(int)AS_NUMBER( index )].method = method;
+        pop();
+        return;
+    }
+
+    // otherwise, append a new slot (note: growing the vtable can trigger a GC, so the method stays on the stack until we're done)
+    if( class->methodCapacity < class->methodCount + 1 ) {
+        int oldCapacity = class->methodCapacity;
+        class->methodCapacity = (int)growCapacity( (size_t)oldCapacity );
+        class->vtable = growArray( sizeof( MethodSlot ), class->vtable, oldCapacity, class->methodCapacity );
+    }
+    class->vtable[class->methodCount] = (MethodSlot){ name, method };
+    tableSet( &class->methods, name, NUMBER_VAL( (double)class->methodCount ) );
+    class->methodCount++;
     pop(); // remove method from stack (leaving class on stack, ready for next method)
 }
 
@@ -241,15 +308,42 @@ void initVM() {
     vm.grayCapacity = 0;
     vm.grayStack = NULL;
     initTable( &vm.globals );
-    initTable( &vm.strings );
+    initStringSet( &vm.strings );
+    vm.globalEpoch = vm.fieldEpoch = 0;
     vm.initString = NULL; // must set this null BEFORE calling makeString, or else a GC could trigger, and try to access vm.initString, which might hold garbage!
     vm.initString = makeString( "init", 4 );
     defineNative( "clock", clockNative );
+    defineNative( "sqrt", sqrtNative );
+    defineNative( "Map", mapNative );
+    defineNative( "mapGet", mapGetNative );
+    defineNative( "mapSet", mapSetNative );
+    defineNative( "mapHas", mapHasNative );
+    defineNative( "mapDelete", mapDeleteNative );
+    defineNative( "mapSize", mapSizeNative );
+    defineNative( "mapNext", mapNextNative );
+    defineNative( "len", lenNative );
+    defineNative( "push", pushNative );
+    defineNative( "pop", popNative );
+    initF64Kernels();
+    defineNative( "Float64Array", f64ArrayNative );
+    defineNative( "f64Sum", f64SumNative );
+    defineNative( "f64Dot", f64DotNative );
+    defineNative( "f64Min", f64MinNative );
+    defineNative( "f64Max", f64MaxNative );
+    defineNative( "f64Axpy", f64AxpyNative );
+    defineNative( "f64Scale", f64ScaleNative );
+    defineNative( "f64Add", f64AddNative );
+    defineNative( "f64Mul", f64MulNative );
+    defineNative( "slice", sliceNative );
+    defineNative( "find", findNative );
+    defineNative( "split", splitNative );
+    defineNative( "trim", trimNative );
+    defineNative( "charCode", charCodeNative );
 }
 
 void freeVM() {
     freeTable( &vm.globals );
-    freeTable( &vm.strings );
+    freeStringSet( &vm.strings );
     vm.initString = NULL;
     freeObjects();
 }
@@ -270,8 +364,9 @@ static InterpretResult run() {
     // macros
     #define READ_BYTE() (*frame->ip++)
     #define READ_USHORT() (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
-    #define READ_CONSTANT() (frame->closure->function->chunk.constants.values[READ_BYTE()])
-    #define READ_STRING() AS_STRING(READ_CONSTANT())
+    #define READ_UINT32() (frame->ip += 4, ((uint32_t)frame->ip[-4] << 24) | ((uint32_t)frame->ip[-3] << 16) | ((uint32_t)frame->ip[-2] << 8) | frame->ip[-1])
+    #define CONSTANT() (frame->function->chunk.constants.values[operand])
+    #define STRING() AS_STRING(CONSTANT())
 
     // this macro looks strange, but it's a way to define a block that permits a semicolon at the end
     #define BINARY_OP(valueType, op) \
@@ -285,12 +380,44 @@ static InterpretResult run() {
             push( valueType( a op b ) ); \
         } while( false )
 
+    // same, for operands the compiler proved are numbers (see OP_ADD_NUM)
+    #define NUMBER_OP(valueType, op) \
+        do { \
+            double b = AS_NUMBER( peek( 0 ) ); \
+            double a = AS_NUMBER( peek( 1 ) ); \
+            vm.stackTop--; \
+            vm.stackTop[-1] = valueType( a op b ); \
+        } while( false )
+
+    // small int fast paths. INT_ARITH replaces both operands with the int result when it's exact (no overflow &
+    //  'ok' holds for it), otherwise it falls through to the double op that follows it
+    #define INT_ARITH(builtin, ok) \
+        if( IS_INT( peek( 0 ) ) && IS_INT( peek( 1 ) ) ) { \
+            int32_t a = AS_INT( peek( 1 ) ), b = AS_INT( peek( 0 ) ), r; \
+            if( !builtin( a, b, &r ) && (ok) ) { \
+                vm.stackTop--; \
+                vm.stackTop[-1] = INT_VAL( r ); \
+                break; \
+            } \
+        }
+    #define INT_COMPARE(op) \
+        if( IS_INT( peek( 0 ) ) && IS_INT( peek( 1 ) ) ) { \
+            bool r = AS_INT( peek( 1 ) ) op AS_INT( peek( 0 ) ); \
+            vm.stackTop--; \
+            vm.stackTop[-1] = BOOL_VAL( r ); \
+            break; \
+        }
+
+    // instructions w/ a constant, slot or jump operand read it into 'operand', then continue at a label, so OP_WIDE can
+    //  read a wider operand & jump into the same body (the common 1-byte path doesn't pay anything for this)
+    uint32_t operand;
+
     // main loop
     for( uint8_t instruction;; ) {
         // trace execution
         #ifdef DEBUG_TRACE_EXECUTION
             // print instruction info
-            disassembleInstruction( &frame->closure->function->chunk, (size_t)(frame->ip - frame->closure->function->chunk.code) );
+            disassembleInstruction( &frame->function->chunk, (size_t)(frame->ip - frame->function->chunk.code) );
 
             // print stack contents
             if( vm.stack < vm.stackTop ) {
@@ -308,29 +435,36 @@ static InterpretResult run() {
 
         // interpret instruction
         switch( instruction = READ_BYTE() ) {
-            case OP_CONSTANT:   push( READ_CONSTANT() ); break;
+            case OP_CONSTANT:   operand = READ_BYTE(); op_constant: push( CONSTANT() ); break;
+            case OP_SMALLINT:   push( INT_VAL( (int8_t)READ_BYTE() ) ); break;
+            case OP_SMALLINT_16: push( INT_VAL( (int16_t)READ_USHORT() ) ); break;
             case OP_NIL:        push( NIL_VAL ); break;
             case OP_TRUE:       push( BOOL_VAL( true ) ); break;
             case OP_FALSE:      push( BOOL_VAL( false ) ); break;
             case OP_POP:        pop(); break;
-            case OP_GET_LOCAL: {
-                uint8_t slot = READ_BYTE(); // get the local's slot
-                push( frame->slots[slot] ); // read the local, and push it onto the stack (for other instructions to use)
+            case OP_POPN:       vm.stackTop -= READ_BYTE(); break;
+            case OP_GET_LOCAL:
+                operand = READ_BYTE(); // get the local's slot
+            op_get_local:
+                push( frame->slots[operand] ); // read the local, and push it onto the stack (for other instructions to use)
                 break;
-            }
-            case OP_SET_LOCAL: {
-                uint8_t slot = READ_BYTE(); // get the local's slot
-                frame->slots[slot] = peek( 0 ); // set the slot to the value that's on the top of the stack (don't pop it, because it's an expression, and so it should return a value which is itself)
+            case OP_SET_LOCAL:
+                operand = READ_BYTE(); // get the local's slot
+            op_set_local:
+                frame->slots[operand] = peek( 0 ); // set the slot to the value that's on the top of the stack (don't pop it, because it's an expression, and so it should return a value which is itself)
                 break;
-            }
-            case OP_DEFINE_GLOBAL: {
-                ObjString* name = READ_STRING();
-                tableSet( &vm.globals, name, peek( 0 ) );
+            case OP_DEFINE_GLOBAL:
+                operand = READ_BYTE();
+            op_define_global: {
+                ObjString* name = STRING();
+                if( tableSet( &vm.globals, name, peek( 0 ) ) ) vm.globalEpoch++; // (entries may have moved, see OP_HOIST_GLOBAL)
                 pop(); // pop AFTER adding it, just in case a GC is triggered (we want to ensure that string still exists on the stack!)
                 break;
             }
-            case OP_GET_GLOBAL: {
-                ObjString* name = READ_STRING();
+            case OP_GET_GLOBAL:
+                operand = READ_BYTE();
+            op_get_global: {
+                ObjString* name = STRING();
                 Value value;
                 if( !tableGet( &vm.globals, name, &value ) ) {
                     runtimeError( "Undefined variable '%.*s'.", (int)name->len, name->buf );
@@ -339,16 +473,21 @@ static InterpretResult run() {
                 push( value );
                 break;
             }
-            case OP_SET_GLOBAL: { // sets the global, but leaves the value on the stack (since setting a value is an expression)
-                ObjString* name = READ_STRING();
+            case OP_SET_GLOBAL: // sets the global, but leaves the value on the stack (since setting a value is an expression)
+                operand = READ_BYTE();
+            op_set_global: {
+                ObjString* name = STRING();
                 if( tableSet( &vm.globals, name, peek(0) ) ) { // set value, but if it's a NEW value then...
                     tableDelete( &vm.globals, name ); // mistake! must use 'DEFINE_GLOBAL' for that!
+                    vm.globalEpoch++;
                     runtimeError( "Undefined variable '%.*s'.", (int)name->len, name->buf );
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 break;
             }
-            case OP_GET_PROPERTY: {
+            case OP_GET_PROPERTY:
+                operand = READ_BYTE();
+            op_get_property: {
                 // validate that top of stack is an instance
                 if( !IS_INSTANCE( peek( 0 ) ) ) {
                     runtimeError( "Only instances have properties." );
@@ -358,8 +497,8 @@ static InterpretResult run() {
                 // get instance from top of stack
                 ObjInstance* instance = AS_INSTANCE( peek( 0 ) );
 
-                // the next bytecode contains a string constant for the field
-                ObjString* name = READ_STRING();
+                // the operand is a string constant for the field
+                ObjString* name = STRING();
 
                 // if we have a field: replace 'instance' on stack with 'value' from the field
                 // (note that fields shadow methods, which is why we check for a field first)
@@ -376,19 +515,25 @@ static InterpretResult run() {
                 }
                 break;
             }
-            case OP_SET_PROPERTY: {
+            case OP_SET_PROPERTY:
+                operand = READ_BYTE();
+            op_set_property: {
                 // ensure we have an instance second-to-top of stack
                 if( !IS_INSTANCE( peek( 1 ) ) ) {
                     runtimeError( "Only instances have fields." );
                     return INTERPRET_RUNTIME_ERROR;
                 }
-
                 // instance is second-to-top of stack
                 ObjInstance* instance = AS_INSTANCE( peek(1) );
 
                 // value to set field to is on top of stack
                 // note that we have to use 'peek' b/c 'pop' might make the value temporarily invisible to the GC (and tableSet can potentially trigger a GC)
-                tableSet( &instance->fields, READ_STRING(), peek(0) );
+                // when this adds a field to a sampled instance, remember how many fields instances of this class grow to (see newInstance)
+                if( tableSet( &instance->fields, STRING(), peek(0) ) ) {
+                    vm.fieldEpoch++; // (entries may have moved, see OP_HOIST_FIELD)
+                    if( instance->isSample && instance->fields.load > instance->class->fieldHint )
+                        instance->class->fieldHint = instance->fields.load < CLASS_MAX_FIELD_HINT ? instance->fields.load : CLASS_MAX_FIELD_HINT;
+                }
 
                 // it is now safe to pop the value (since we've already stashed it into a table)
                 Value value = pop();
@@ -399,33 +544,27 @@ static InterpretResult run() {
                 break;
             }
             case OP_EQUAL: {
-                Value b = pop();
-                Value a = pop();
-                push( BOOL_VAL( valuesEqual( a, b ) ) );
+                // compare before popping (comparing ropes flattens them, which allocates)
+                bool equal = valuesEqual( peek( 1 ), peek( 0 ) );
+                vm.stackTop -= 2;
+                push( BOOL_VAL( equal ) );
                 break;
             }
-            case OP_GET_UPVALUE: {
-                uint8_t slot = READ_BYTE();
-                push(*frame->closure->upvalues[slot]->location);
-                break;
-            }
-            case OP_SET_UPVALUE: {
-                uint8_t slot = READ_BYTE();
-                *frame->closure->upvalues[slot]->location = peek( 0 );
-                break;
-            }
-            case OP_GREATER:    BINARY_OP(BOOL_VAL, >); break;
-            case OP_LESS:       BINARY_OP(BOOL_VAL, <); break;
+            case OP_GET_UPVALUE: operand = READ_BYTE(); op_get_upvalue: push( *frame->upvalues[operand]->location ); break;
+            case OP_SET_UPVALUE: operand = READ_BYTE(); op_set_upvalue: *frame->upvalues[operand]->location = peek( 0 ); break;
+            case OP_GET_CAPTURE: operand = READ_BYTE(); op_get_capture: push( frame->captures[operand] ); break;
+            case OP_GREATER:    INT_COMPARE(>) BINARY_OP(BOOL_VAL, >); break;
+            case OP_LESS:       INT_COMPARE(<) BINARY_OP(BOOL_VAL, <); break;
             case OP_ADD: {
-                if( IS_STRING( peek(0) ) && IS_STRING( peek(1) ) ) {
+                INT_ARITH(__builtin_add_overflow, true)
+                if( isStringValue( peek(0) ) && isStringValue( peek(1) ) ) {
                     // EP: isn't this a potential GC problem since the strings won't exist on the stack (so a concurrent GC could collect them after pop, but before concat?)
                     // EP on GC chaper: yes, it is!
-                    ObjString* b = AS_STRING( peek( 0 ) );
-                    ObjString* a = AS_STRING( peek( 1 ) );
-                    ObjString* c = concatStrings( a->buf, a->len, b->buf, b->len );
-                    pop(); // pop a
+                    // long results become ropes (see concatValues), so appending in a loop doesn't copy the whole string every time
+                    Value c = concatValues( peek( 1 ), peek( 0 ) );
                     pop(); // pop b
-                    push( OBJ_VAL( c ) );
+                    pop(); // pop a
+                    push( c );
                 } else if( IS_NUMBER( peek(0) ) && IS_NUMBER( peek(1) ) ) {
                     double b = AS_NUMBER( pop() );
                     double a = AS_NUMBER( pop() );
@@ -436,77 +575,107 @@ static InterpretResult run() {
                 }
                 break;
             }
-            case OP_SUBTRACT:   BINARY_OP(NUMBER_VAL,-); break;
-            case OP_MULTIPLY:   BINARY_OP(NUMBER_VAL,*); break;
+            case OP_SUBTRACT:   INT_ARITH(__builtin_sub_overflow, true) BINARY_OP(NUMBER_VAL,-); break;
+            case OP_MULTIPLY:   INT_ARITH(__builtin_mul_overflow, r != 0 || (a | b) >= 0) BINARY_OP(NUMBER_VAL,*); break; // 0 * -n is -0
             case OP_DIVIDE:     BINARY_OP(NUMBER_VAL,/); break;
             case OP_NOT:        push( BOOL_VAL( isFalsey( pop() ) ) ); break;
             case OP_NEGATE:
+                if( IS_INT( peek( 0 ) ) && AS_INT( peek( 0 ) ) != 0 && AS_INT( peek( 0 ) ) != INT32_MIN ) { // -0 is a double
+                    vm.stackTop[-1] = INT_VAL( -AS_INT( peek( 0 ) ) );
+                    break;
+                }
                 if( !IS_NUMBER( peek( 0 ) ) ) {
                     runtimeError( "Operand must be a number." );
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 push( NUMBER_VAL( -AS_NUMBER( pop() ) ) );
                 break;
-            case OP_PRINT: printValue( pop() ); printf( "\n" ); break;
-            case OP_JUMP: {
-                uint16_t offset = READ_USHORT();
-                frame->ip += offset;
+            case OP_GREATER_NUM:    INT_COMPARE(>) NUMBER_OP(BOOL_VAL, >); break;
+            case OP_LESS_NUM:       INT_COMPARE(<) NUMBER_OP(BOOL_VAL, <); break;
+            case OP_ADD_NUM:        INT_ARITH(__builtin_add_overflow, true) NUMBER_OP(NUMBER_VAL, +); break;
+            case OP_SUBTRACT_NUM:   INT_ARITH(__builtin_sub_overflow, true) NUMBER_OP(NUMBER_VAL, -); break;
+            case OP_MULTIPLY_NUM:   INT_ARITH(__builtin_mul_overflow, r != 0 || (a | b) >= 0) NUMBER_OP(NUMBER_VAL, *); break;
+            case OP_DIVIDE_NUM:     NUMBER_OP(NUMBER_VAL, /); break;
+            case OP_NEGATE_NUM:
+                if( IS_INT( peek( 0 ) ) && AS_INT( peek( 0 ) ) != 0 && AS_INT( peek( 0 ) ) != INT32_MIN ) vm.stackTop[-1] = INT_VAL( -AS_INT( peek( 0 ) ) );
+                else vm.stackTop[-1] = NUMBER_VAL( -AS_NUMBER( peek( 0 ) ) );
                 break;
-            }
-            case OP_JUMP_IF_FALSE: {
-                uint16_t offset = READ_USHORT();
+            case OP_PRINT: printValue( peek( 0 ) ); printf( "\n" ); pop(); break; // printing a rope flattens it (which allocates)
+            case OP_JUMP:
+                operand = READ_USHORT();
+            op_jump:
+                frame->ip += operand;
+                break;
+            case OP_JUMP_IF_FALSE:
+                operand = READ_USHORT();
+            op_jump_if_false:
                 //if( isFalsey( peek( 0 ) ) ) vm.ip += offset;
-                frame->ip += offset * isFalsey( peek( 0 ) ); // no branching version of above
+                frame->ip += operand * isFalsey( peek( 0 ) ); // no branching version of above
                 break;
-            }
-            case OP_LOOP: {
-                uint16_t offset = READ_USHORT();
-                frame->ip -= offset;
+            case OP_LOOP:
+                operand = READ_USHORT();
+            op_loop:
+                frame->ip -= operand;
                 break;
-            }
             case OP_CALL: {
                 int argCount = READ_BYTE();
                 if( !callValue( peek( argCount ), argCount ) ) return INTERPRET_RUNTIME_ERROR;
                 frame = &vm.frames[vm.frameCount - 1]; // callValue changed the VM frame, so update our local variable
                 break;
             }
-            case OP_INVOKE: {
-                ObjString* method = READ_STRING();
+            case OP_INVOKE:
+                operand = READ_BYTE();
+            op_invoke: {
+                ObjString* method = STRING();
                 int argCount = READ_BYTE();
-                if( !invoke( method, argCount ) ) return INTERPRET_RUNTIME_ERROR;
+                uint8_t* slot = frame->ip++; // cached vtable slot (updated in place on a miss)
+                if( !invoke( method, argCount, slot ) ) return INTERPRET_RUNTIME_ERROR;
 
                 // after invoke, there's a new call frame on the stack, so refresh our local copy
                 frame = &vm.frames[vm.frameCount - 1];
                 break;
             }
 
-            case OP_SUPER_INVOKE: {
+            case OP_SUPER_INVOKE:
+                operand = READ_BYTE();
+            op_super_invoke: {
                 // pull method & argCount from instructions
-                ObjString* method = READ_STRING();
+                ObjString* method = STRING();
                 int argCount = READ_BYTE();
+                uint8_t* slot = frame->ip++; // cached vtable slot (the superclass is fixed for this call site, so this always hits after the 1st call)
 
                 // pop superclass from stack
                 ObjClass* superclass = AS_CLASS( pop() );
 
                 // directly invoke the method
-                if( !invokeFromClass( superclass, method, argCount ) ) return INTERPRET_RUNTIME_ERROR;
+                if( !invokeFromClass( superclass, method, argCount, slot ) ) return INTERPRET_RUNTIME_ERROR;
 
                 // after invoke, there's a new call frame on the stack, so refresh our local copy
                 frame = &vm.frames[vm.frameCount - 1];
                 break;
             }
             
-            case OP_CLOSURE: {
+            case OP_CLOSURE:
+                operand = READ_BYTE();
+            op_closure: {
                 // push the closure to the stack
-                ObjFunction* function = AS_FUNCTION( READ_CONSTANT() );
+                ObjFunction* function = AS_FUNCTION( CONSTANT() );
                 ObjClosure* closure = newClosure( function );
                 push( OBJ_VAL( closure ) );
 
-                // read the upvalues
+                // read the upvalues (bit 1 of 'isLocal' means the index takes 2 bytes, see emitClosureVariables)
                 for( int i = 0; i < closure->upvalueCount; i++ ) {
-                    uint8_t isLocal = READ_BYTE(), index = READ_BYTE();
-                    closure->upvalues[i] = isLocal ? captureUpvalue( frame->slots + index ) :
-                                                     frame->closure->upvalues[index];
+                    uint8_t isLocal = READ_BYTE();
+                    int index = isLocal & 2 ? READ_USHORT() : READ_BYTE();
+                    closure->upvalues[i] = isLocal & 1 ? captureUpvalue( frame->slots + index ) :
+                                                         frame->upvalues[index];
+                }
+
+                // copy the values captured by value (no allocation needed)
+                for( int i = 0; i < closure->captureCount; i++ ) {
+                    uint8_t isLocal = READ_BYTE();
+                    int index = isLocal & 2 ? READ_USHORT() : READ_BYTE();
+                    closure->captures[i] = isLocal & 1 ? frame->slots[index] : frame->captures[index];
                 }
                 break;
             }
@@ -538,16 +707,10 @@ static InterpretResult run() {
             }
             
             // creates a new class
-            case OP_CLASS: {
-                push( OBJ_VAL( newClass( READ_STRING() ) ) );
-                break;
-            }
+            case OP_CLASS: operand = READ_BYTE(); op_class: push( OBJ_VAL( newClass( STRING() ) ) ); break;
 
             // creates a new method
-            case OP_METHOD: {
-                defineMethod( READ_STRING() );
-                break;
-            }
+            case OP_METHOD: operand = READ_BYTE(); op_method: defineMethod( STRING() ); break;
 
             case OP_INHERIT: {
                 // get superclass
@@ -564,16 +727,26 @@ static InterpretResult run() {
                 // "copy-down inheritance", which makes method invocation *fast*
                 // this only works b/c user cannot add methods to the superclass at runtime
                 // also note: this runs BEFORE methods are defined on the class, so it can override any of the superclass methods
-                tableAddAll( &AS_CLASS( superclass )->methods, &subclass->methods );
+                // the vtable is copied as-is, so inherited methods keep their slots (& cached slots work across the hierarchy)
+                ObjClass* super = AS_CLASS( superclass );
+                tableAddAll( &super->methods, &subclass->methods );
+                if( 0 != super->methodCount ) {
+                    subclass->vtable = growArray( sizeof( MethodSlot ), NULL, 0, super->methodCount ); // both classes are on the stack, so a GC here is fine
+                    memcpy( subclass->vtable, super->vtable, sizeof( MethodSlot ) * super->methodCount );
+                    subclass->methodCount = subclass->methodCapacity = super->methodCount;
+                }
+                subclass->initializer = super->initializer; // (but not the fieldHint: subclasses sample their own instances)
 
                 // pop the subclass (leaving the superclass)
                 pop();
                 break;
             }
 
-            case OP_GET_SUPER: {
+            case OP_GET_SUPER:
+                operand = READ_BYTE();
+            op_get_super: {
                 // get method name from constant table
-                ObjString* name = READ_STRING();
+                ObjString* name = STRING();
 
                 // pop superclass from stack
                 ObjClass* superclass = AS_CLASS( pop() );
@@ -586,6 +759,247 @@ static InterpretResult run() {
                 break;
             }
 
+            case OP_ARRAY: {
+                // build the array from the elements on top of the stack
+                uint8_t count = READ_BYTE();
+                ObjArray* array = newArray( vm.stackTop - count, count );
+                vm.stackTop -= count;
+                push( OBJ_VAL( array ) );
+                break;
+            }
+
+            case OP_GET_INDEX: {
+                Value target = peek( 1 ), index = peek( 0 );
+                if( IS_ARRAY( target ) ) {
+                    ValueArray* values = &AS_ARRAY( target )->values;
+                    size_t i;
+                    if( !arrayIndex( index, values->count, &i ) ) return INTERPRET_RUNTIME_ERROR;
+                    vm.stackTop -= 2;
+                    push( values->values[i] );
+                } else if( IS_F64ARRAY( target ) ) {
+                    ObjF64Array* array = AS_F64ARRAY( target );
+                    size_t i;
+                    if( !arrayIndex( index, array->count, &i ) ) return INTERPRET_RUNTIME_ERROR;
+                    vm.stackTop -= 2;
+                    push( NUMBER_VAL( array->data[i] ) );
+                } else if( IS_MAP( target ) ) {
+                    Value value;
+                    if( !mapGet( AS_MAP( target ), index, &value ) ) value = NIL_VAL;
+                    vm.stackTop -= 2;
+                    push( value );
+                } else {
+                    runtimeError( "Only arrays and maps can be indexed." );
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+
+            case OP_SET_INDEX: {
+                // note: everything stays on the stack until we're done, since mapSet can trigger a GC
+                Value target = peek( 2 ), index = peek( 1 ), value = peek( 0 );
+                if( IS_ARRAY( target ) ) {
+                    ValueArray* values = &AS_ARRAY( target )->values;
+                    size_t i;
+                    if( !arrayIndex( index, values->count, &i ) ) return INTERPRET_RUNTIME_ERROR;
+                    values->values[i] = value;
+                } else if( IS_F64ARRAY( target ) ) {
+                    ObjF64Array* array = AS_F64ARRAY( target );
+                    size_t i;
+                    if( !arrayIndex( index, array->count, &i ) ) return INTERPRET_RUNTIME_ERROR;
+                    if( !IS_NUMBER( value ) ) {
+                        runtimeError( "Float64Array elements must be numbers." );
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                    array->data[i] = AS_NUMBER( value );
+                } else if( IS_MAP( target ) ) {
+                    if( !isMapKey( index ) ) { // (the same check as mapSet())
+                        runtimeError( "Map key cannot be nil or NaN." );
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                    mapSet( AS_MAP( target ), index, value );
+                } else {
+                    runtimeError( "Only arrays and maps can be indexed." );
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+
+                // 'set index' is an expression that returns the value it was set to
+                vm.stackTop -= 3;
+                push( value );
+                break;
+            }
+
+            // inlined calls: the callee's body follows the guard, working on the arguments where they are. if the callee
+            //  isn't the function that was inlined anymore, we make the call for real & skip the body (the jump counts
+            //  from the end of its operand, like OP_JUMP's)
+            case OP_GUARD_CALL:
+                operand = READ_USHORT();
+            op_guard_call: {
+                uint8_t* skip = frame->ip + operand;
+                ObjFunction* function = AS_FUNCTION( frame->function->chunk.constants.values[READ_USHORT()] );
+                int argCount = READ_BYTE();
+                if( IS_OBJ( peek( argCount ) ) && AS_OBJ( peek( argCount ) ) == (Obj*)function ) break;
+                frame->ip = skip;
+                if( !callValue( peek( argCount ), argCount ) ) return INTERPRET_RUNTIME_ERROR;
+                frame = &vm.frames[vm.frameCount - 1];
+                break;
+            }
+            case OP_GUARD_INVOKE:
+                operand = READ_USHORT();
+            op_guard_invoke: {
+                // the method's name is the inlined function's name. a field w/ that name would be called instead
+                uint8_t* skip = frame->ip + operand;
+                ObjFunction* function = AS_FUNCTION( frame->function->chunk.constants.values[READ_USHORT()] );
+                int argCount = READ_BYTE();
+                uint8_t* slot = frame->ip++;
+                Value receiver = peek( argCount ), field;
+                if( IS_INSTANCE( receiver ) && !tableGet( &AS_INSTANCE( receiver )->fields, function->name, &field ) &&
+                    findMethod( AS_INSTANCE( receiver )->class, function->name, slot ) == (Obj*)function ) break;
+                frame->ip = skip;
+                if( !invoke( function->name, argCount, slot ) ) return INTERPRET_RUNTIME_ERROR;
+                frame = &vm.frames[vm.frameCount - 1];
+                break;
+            }
+            // counted loops (see countLoops in optimizer.c): the counter is a local, compared (& incremented) in place w/
+            //  a local or constant limit. the jump counts from the end of its operand, & anything that isn't a pair of
+            //  small ints does what the comparison & increment would have done in the loop's generic form
+            case OP_FOR_PREP: case OP_FOR_PREP_CONSTANT:
+                operand = READ_USHORT();
+            op_for_prep: {
+                uint8_t* exit = frame->ip + operand;
+                Value counter = frame->slots[READ_BYTE()];
+                Value limit = OP_FOR_PREP == instruction ? frame->slots[READ_BYTE()] : frame->function->chunk.constants.values[READ_BYTE()];
+                if( IS_INT( counter ) && IS_INT( limit ) ) {
+                    if( AS_INT( counter ) >= AS_INT( limit ) ) frame->ip = exit;
+                    break;
+                }
+                if( !IS_NUMBER( counter ) || !IS_NUMBER( limit ) ) {
+                    runtimeError( "Operands must be numbers." );
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if( !(AS_NUMBER( counter ) < AS_NUMBER( limit )) ) frame->ip = exit;
+                break;
+            }
+            case OP_FOR_LOOP: case OP_FOR_LOOP_CONSTANT:
+                operand = READ_USHORT();
+            op_for_loop: {
+                uint8_t* body = frame->ip - operand;
+                Value* counter = &frame->slots[READ_BYTE()];
+                Value limit = OP_FOR_LOOP == instruction ? frame->slots[READ_BYTE()] : frame->function->chunk.constants.values[READ_BYTE()];
+                if( IS_INT( *counter ) && IS_INT( limit ) && AS_INT( *counter ) < INT32_MAX ) {
+                    int32_t i = AS_INT( *counter ) + 1;
+                    *counter = INT_VAL( i );
+                    if( i < AS_INT( limit ) ) frame->ip = body;
+                    break;
+                }
+                if( !IS_NUMBER( *counter ) ) {
+                    runtimeError( "Operands must be two numbers or two strings." );
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                *counter = NUMBER_VAL( AS_NUMBER( *counter ) + 1 );
+                if( !IS_NUMBER( limit ) ) {
+                    runtimeError( "Operands must be numbers." );
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if( AS_NUMBER( *counter ) < AS_NUMBER( limit ) ) frame->ip = body;
+                break;
+            }
+            case OP_PEEK: push( peek( READ_BYTE() ) ); break;
+            case OP_INLINE_RETURN: {
+                Value result = peek( 0 );
+                vm.stackTop -= READ_BYTE();
+                vm.stackTop[-1] = result;
+                break;
+            }
+
+            // loop-invariant loads: before the loop, the entry a global (or field of 'this') lives in is found & kept in 2
+            //  hidden locals, its index & the epoch it was found in. inside the loop, reads go straight to that entry (so
+            //  they see every store) as long as no key has been added or deleted since, which is the only time entries move.
+            //  a global that isn't there yet (or a 'field' that's really a method) starts out stale, so the 1st read does
+            //  the real lookup (& reports the error, if there is one)
+            case OP_HOIST_GLOBAL: {
+                operand = READ_BYTE();
+                Entry* entry = tableFind( &vm.globals, STRING() );
+                push( NULL == entry ? NIL_VAL : NUMBER_VAL( (double)(entry - vm.globals.entries) ) );
+                push( NUMBER_VAL( NULL == entry ? -1 : (double)vm.globalEpoch ) );
+                break;
+            }
+            case OP_HOIST_FIELD: {
+                operand = READ_BYTE();
+                Value receiver = frame->slots[0];
+                Entry* entry = IS_INSTANCE( receiver ) ? tableFind( &AS_INSTANCE( receiver )->fields, STRING() ) : NULL;
+                push( NULL == entry ? NIL_VAL : NUMBER_VAL( (double)(entry - AS_INSTANCE( receiver )->fields.entries) ) );
+                push( NUMBER_VAL( NULL == entry ? -1 : (double)vm.fieldEpoch ) );
+                break;
+            }
+            case OP_GET_HOISTED_GLOBAL: {
+                Value* hoisted = &frame->slots[READ_BYTE()];
+                operand = READ_BYTE();
+                if( AS_NUMBER( hoisted[1] ) != (double)vm.globalEpoch ) {
+                    ObjString* name = STRING();
+                    Entry* entry = tableFind( &vm.globals, name );
+                    if( NULL == entry ) {
+                        runtimeError( "Undefined variable '%.*s'.", (int)name->len, name->buf );
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                    hoisted[0] = NUMBER_VAL( (double)(entry - vm.globals.entries) );
+                    hoisted[1] = NUMBER_VAL( (double)vm.globalEpoch );
+                }
+                push( vm.globals.entries[(size_t)AS_NUMBER( hoisted[0] )].value );
+                break;
+            }
+            case OP_GET_HOISTED_FIELD: {
+                Value* hoisted = &frame->slots[READ_BYTE()];
+                operand = READ_BYTE();
+                Value receiver = frame->slots[0];
+                if( AS_NUMBER( hoisted[1] ) != (double)vm.fieldEpoch ) {
+                    Entry* entry = IS_INSTANCE( receiver ) ? tableFind( &AS_INSTANCE( receiver )->fields, STRING() ) : NULL;
+                    if( NULL == entry ) {
+                        push( receiver );
+                        goto op_get_property; // not a field: do what OP_GET_PROPERTY does w/ it
+                    }
+                    hoisted[0] = NUMBER_VAL( (double)(entry - AS_INSTANCE( receiver )->fields.entries) );
+                    hoisted[1] = NUMBER_VAL( (double)vm.fieldEpoch );
+                }
+                push( AS_INSTANCE( receiver )->fields.entries[(size_t)AS_NUMBER( hoisted[0] )].value );
+                break;
+            }
+
+            // doubles the width of the next instruction's operand, then continues in that instruction's body
+            case OP_WIDE:
+                switch( instruction = READ_BYTE() ) {
+                    case OP_JUMP:           operand = READ_UINT32(); goto op_jump;
+                    case OP_JUMP_IF_FALSE:  operand = READ_UINT32(); goto op_jump_if_false;
+                    case OP_LOOP:           operand = READ_UINT32(); goto op_loop;
+                    case OP_GUARD_CALL:     operand = READ_UINT32(); goto op_guard_call;
+                    case OP_GUARD_INVOKE:   operand = READ_UINT32(); goto op_guard_invoke;
+                    case OP_FOR_PREP:       operand = READ_UINT32(); goto op_for_prep;
+                    case OP_FOR_LOOP:       operand = READ_UINT32(); goto op_for_loop;
+                    case OP_FOR_PREP_CONSTANT: operand = READ_UINT32(); goto op_for_prep;
+                    case OP_FOR_LOOP_CONSTANT: operand = READ_UINT32(); goto op_for_loop;
+                    default:                operand = READ_USHORT(); break;
+                }
+                switch( instruction ) {
+                    case OP_CONSTANT:       goto op_constant;
+                    case OP_GET_LOCAL:      goto op_get_local;
+                    case OP_SET_LOCAL:      goto op_set_local;
+                    case OP_DEFINE_GLOBAL:  goto op_define_global;
+                    case OP_GET_GLOBAL:     goto op_get_global;
+                    case OP_SET_GLOBAL:     goto op_set_global;
+                    case OP_GET_PROPERTY:   goto op_get_property;
+                    case OP_SET_PROPERTY:   goto op_set_property;
+                    case OP_GET_UPVALUE:    goto op_get_upvalue;
+                    case OP_SET_UPVALUE:    goto op_set_upvalue;
+                    case OP_GET_CAPTURE:    goto op_get_capture;
+                    case OP_INVOKE:         goto op_invoke;
+                    case OP_SUPER_INVOKE:   goto op_super_invoke;
+                    case OP_CLOSURE:        goto op_closure;
+                    case OP_CLASS:          goto op_class;
+                    case OP_METHOD:         goto op_method;
+                    case OP_GET_SUPER:      goto op_get_super;
+                }
+                runtimeError( "unrecognized wide opcode: %d", instruction );
+                return INTERPRET_RUNTIME_ERROR;
+
             // not in book: error on unrecognized opcodes
             default:
                 runtimeError( "unrecognized opcode: %d", instruction );
@@ -596,9 +1010,13 @@ static InterpretResult run() {
     // undefine macros
     #undef READ_BYTE
     #undef READ_USHORT
-    #undef READ_CONSTANT
-    #undef READ_STRING
+    #undef READ_UINT32
+    #undef CONSTANT
+    #undef STRING
     #undef BINARY_OP
+    #undef NUMBER_OP
+    #undef INT_ARITH
+    #undef INT_COMPARE
 }
 
 static Value interpret_main( ObjFunction* main, Value keepAlive ) {
@@ -609,14 +1027,9 @@ static Value interpret_main( ObjFunction* main, Value keepAlive ) {
     resetStack();
     push( keepAlive );
 
-    // wrap main in a closure (this allocates and triggers a GC)
+    // call main (it never captures anything, so there's no need to wrap it in a closure)
     push( OBJ_VAL( main ) );
-    ObjClosure* closure = newClosure( main );
-    pop();
-    push( OBJ_VAL( closure ) );
-
-    // replace main function with clousre
-    call( closure, 0 );
+    if( !call( main, NULL, 0 ) ) return ERROR_VAL( RUNTIME_ERROR );
 
     // run VM
     InterpretResult result = run();
@@ -1,14 +1,19 @@
 #pragma once
 #include "chunk.h"
 #include "table.h"
+#include "intern.h"
 #include "value.h"
 #include "object.h"
 
 #define FRAMES_MAX 64 // maximum call depth
-#define STACK_MAX (FRAMES_MAX * UINT8_COUNT) // up to 256 variables for each function call (probably overkill?)
+#define STACK_MAX (FRAMES_MAX * UINT8_COUNT) // 256 slots for each function call on average
+#define STACK_SLACK UINT8_COUNT // room a call needs past its locals, for temporaries & the arguments to its own calls
 
 typedef struct {
-    ObjClosure* closure; // current closure being called
+    ObjFunction* function; // current function being called
+    ObjClosure* closure; // the closure it was called through (NULL for functions w/o upvalues). keeps upvalues alive
+    ObjUpvalue** upvalues; // closure->upvalues (cached, so upvalue access skips a load)
+    Value* captures; // closure->captures (cached)
     uint8_t* ip; // the instruction pointer for the caller (i.e. where to return to after we finish function execution)
     Value* slots; // points into the VM's Value stack @ the point where the function's arguments begin
 } CallFrame;
@@ -18,8 +23,10 @@ typedef struct {
     int frameCount; // the call depth
     Value stack[STACK_MAX]; // our value stack
     Value* stackTop; // pointer to the latest value in the stack
-    Table globals, strings; // for global variables, for string interning
+    Table globals; // for global variables
+    StringSet strings; // for string interning (weak: GC removes unmarked strings)
     ObjString* initString; // name of initializer method for classes
+    uint32_t globalEpoch, fieldEpoch; // bumped whenever a global (or any field) is added or deleted, so hoisted loads know when to look again
     ObjUpvalue* openUpvalues; // for all closed-over upvalues
     size_t bytesAllocated, nextGC; // for tracking when to GC next
     Obj* objects; // for keeping track of all objects, so we can GC them
@@ -40,5 +47,6 @@ void initVM();
 void freeVM();
 Value interpret( const char* source, Value keepAlive );
 Value interpret_chunk( Chunk chunk );
+void runtimeError( const char* format, ... ); // prints the error & a stack trace, then resets the stack
 void push( Value value );
 Value pop();